@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/* the same batch files under mysh, dash and bash (those that are installed): stdout and exit status are compared with mysh's,
+   and wall time, CPU time and processes created are reported side by side
+   usage: compareShells mysh results.json   (run from P3, "make benchCompare" does it) */
+
+#define RUNS 3 // the fastest of RUNS is reported
+#define MAX_SCRIPTS 256
+#define TIME_LIMIT 30 // seconds a run may take before it is killed
+
+/* shell under comparison */
+typedef struct {
+    const char *name;
+    char path[PATH_MAX];
+} shellEntry;
+
+/* outcome of running one script under one shell */
+typedef struct {
+    int ran; // 0 if it could not be run
+    int exitStatus; // 128 + the signal if it was killed
+    double wall; // seconds
+    double cpu; // user + system seconds of the shell and everything it waited for
+    long forks; // processes created on the whole machine while it ran
+    char outFile[PATH_MAX]; // its STDOUT
+} runResult;
+
+static char baseDir[] = "/tmp/myshCompareXXXXXX";
+static char workDir[PATH_MAX]; // each run starts in an empty copy of this directory, so every shell sees the same paths
+static char testsDir[PATH_MAX]; // P3/tests, linked into workDir so the test scripts find their files
+
+/* function to read the number of processes created since boot from /proc/stat, -1 if it is not available */
+long processesCreated()
+{
+    FILE *stat = fopen("/proc/stat", "r");
+    if (!stat) return -1;
+
+    char line[256];
+    long count = -1;
+
+    while (fgets(line, sizeof(line), stat))
+    {
+        if (sscanf(line, "processes %ld", &count) == 1) break;
+    }
+
+    fclose(stat);
+    return count;
+}
+
+/* function to empty workDir and link the tests into it again */
+int resetWorkDir()
+{
+    char command[4 * PATH_MAX + 64];
+    snprintf(command, sizeof(command), "rm -rf '%s' && mkdir '%s' && ln -s '%s' '%s/tests'", workDir, workDir, testsDir, workDir);
+    return system(command) == 0 ? 0 : -1;
+}
+
+/* function to run a script once under a shell from workDir, with STDIN on /dev/null, STDOUT in outFile and STDERR discarded */
+void runOnce(const char *shell, const char *script, const char *outFile, runResult *result)
+{
+    result->ran = 0;
+    if (resetWorkDir() < 0) return;
+
+    long before = processesCreated();
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int in = open("/dev/null", O_RDONLY);
+        int out = open(outFile, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+        int err = open("/dev/null", O_WRONLY);
+        if (in < 0 || out < 0 || err < 0 || chdir(workDir) < 0) _exit(127);
+
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+
+        unsetenv("MYSH_TIME");
+        unsetenv("MYSH_TRACE");
+        unsetenv("MYSH_CHROME_TRACE");
+
+        alarm(TIME_LIMIT); // kept across exec, a script that hangs is killed
+        execl(shell, shell, script, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) return;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long after = processesCreated();
+
+    result->ran = 1;
+    result->exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    result->wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    result->cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    result->forks = (before >= 0 && after >= 0) ? after - before - 1 : -1; // the driver's own fork is not counted
+}
+
+/* function to run a script RUNS times under a shell and keep the fastest run; its STDOUT stays in result->outFile */
+void runScript(const char *shell, const char *script, const char *outFile, runResult *result)
+{
+    runResult run;
+    result->ran = 0;
+    snprintf(result->outFile, sizeof(result->outFile), "%s", outFile);
+
+    char tryFile[PATH_MAX + 8];
+    snprintf(tryFile, sizeof(tryFile), "%s.try", outFile);
+
+    for (int i = 0; i < RUNS; i++)
+    {
+        runOnce(shell, script, tryFile, &run);
+        if (!run.ran || (result->ran && run.wall >= result->wall)) continue;
+
+        snprintf(run.outFile, sizeof(run.outFile), "%s", outFile);
+        *result = run;
+        rename(tryFile, outFile);
+    }
+
+    unlink(tryFile);
+}
+
+/* function to check whether two files hold the same bytes */
+int sameOutput(const char *a, const char *b)
+{
+    FILE *x = fopen(a, "r"), *y = fopen(b, "r");
+    int same = (x != NULL && y != NULL);
+
+    while (same)
+    {
+        int c = fgetc(x), d = fgetc(y);
+        if (c != d) same = 0;
+        if (c == EOF || d == EOF) break;
+    }
+
+    if (x) fclose(x);
+    if (y) fclose(y);
+    return same;
+}
+
+/* function to write the generated stress scripts into dir, adding their paths to scripts; they use only syntax every shell shares */
+int generateScripts(const char *dir, char scripts[][PATH_MAX], int count)
+{
+    static const char *names[] = {"stressEcho.sh", "stressSpawn.sh", "stressPipeline.sh", "stressRedirect.sh"};
+
+    for (int k = 0; k < 4 && count < MAX_SCRIPTS; k++)
+    {
+        snprintf(scripts[count], PATH_MAX, "%s/%s", dir, names[k]);
+        FILE *script = fopen(scripts[count], "w");
+        if (!script) continue;
+
+        for (int i = 0; i < 1000; i++)
+        {
+            switch (k)
+            {
+                case 0: fprintf(script, "echo line %d of a script made of echo\n", i); break;
+                case 1: if (i < 300) fprintf(script, "/bin/true\n"); break;
+                case 2: if (i < 200) fprintf(script, "echo pipeline %d | cat | wc -c\n", i); break;
+                default:
+                    if (i < 300) fprintf(script, "echo redirected %d > out%d.txt\n", i, i % 4);
+                    if (i < 300 && i % 4 == 3) fprintf(script, "cat < out%d.txt\n", i % 4);
+                    break;
+            }
+        }
+
+        fclose(script);
+        count++;
+    }
+
+    return count;
+}
+
+/* function to compare script names for qsort, so the report keeps one order */
+int compareNames(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s mysh results.json\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    shellEntry shells[3] = {{"mysh", ""}, {"dash", ""}, {"bash", ""}};
+    int numShells = 1;
+
+    if (!realpath(argv[1], shells[0].path) || !realpath("tests", testsDir))
+    {
+        fprintf(stderr, "%s and tests/ must exist (run from P3)\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    /* the other shells, whichever are installed */
+    const char *candidates[][2] = {{"dash", "/usr/bin/dash"}, {"dash", "/bin/dash"}, {"bash", "/usr/bin/bash"}, {"bash", "/bin/bash"}};
+    for (int i = 0; i < 4; i++)
+    {
+        int known = 0;
+        for (int j = 0; j < numShells; j++) known |= (strcmp(shells[j].name, candidates[i][0]) == 0);
+
+        if (!known && access(candidates[i][1], X_OK) == 0)
+        {
+            shells[numShells].name = candidates[i][0];
+            snprintf(shells[numShells].path, PATH_MAX, "%s", candidates[i][1]);
+            numShells++;
+        }
+    }
+
+    if (!mkdtemp(baseDir))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    snprintf(workDir, sizeof(workDir), "%s/work", baseDir);
+
+    /* the corpus: the test batch files, myscript.sh, and the generated scripts */
+    static char scripts[MAX_SCRIPTS][PATH_MAX];
+    int numScripts = 0;
+
+    DIR *files = opendir("tests/files");
+    struct dirent *entry;
+
+    while (files && (entry = readdir(files)) != NULL && numScripts < MAX_SCRIPTS - 5)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length < 5 || strcmp(entry->d_name + length - 4, ".txt") != 0) continue;
+
+        if (snprintf(scripts[numScripts], PATH_MAX, "%s/files/%s", testsDir, entry->d_name) < PATH_MAX) numScripts++;
+    }
+
+    if (files) closedir(files);
+    qsort(scripts, numScripts, PATH_MAX, compareNames);
+
+    if (realpath("myscript.sh", scripts[numScripts])) numScripts++;
+    numScripts = generateScripts(baseDir, scripts, numScripts);
+
+    FILE *results = fopen(argv[2], "w");
+    if (!results)
+    {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-30s", "script");
+    for (int j = 0; j < numShells; j++) printf(" | %-6s %8s %8s %6s %5s", shells[j].name, "wall ms", "cpu ms", "forks", "same");
+    printf("\n");
+
+    double totalWall[3] = {0}, totalCpu[3] = {0};
+    long totalForks[3] = {0};
+    int matches[3] = {0};
+
+    for (int i = 0; i < numScripts; i++)
+    {
+        const char *name = strrchr(scripts[i], '/') + 1;
+        runResult runs[3];
+
+        for (int j = 0; j < numShells; j++)
+        {
+            char outFile[PATH_MAX];
+            snprintf(outFile, sizeof(outFile), "%s/%s.out", baseDir, shells[j].name);
+            runScript(shells[j].path, scripts[i], outFile, &runs[j]);
+        }
+
+        printf("%-30.30s", name);
+        fprintf(results, "{\"script\":\"%s\",\"shells\":[", name);
+
+        for (int j = 0; j < numShells; j++)
+        {
+            runResult *run = &runs[j];
+
+            /* mysh is the reference; its own column says whether it ran */
+            int same = run->ran && runs[0].ran && run->exitStatus == runs[0].exitStatus && sameOutput(run->outFile, runs[0].outFile);
+
+            if (!run->ran)
+            {
+                printf(" | %-6s %8s %8s %6s %5s", "", "failed", "-", "-", "-");
+                fprintf(results, "%s{\"shell\":\"%s\",\"ran\":false}", j ? "," : "", shells[j].name);
+                continue;
+            }
+
+            printf(" | %-6d %8.1f %8.1f %6ld %5s", run->exitStatus, run->wall * 1e3, run->cpu * 1e3, run->forks, same ? "yes" : "no");
+            fprintf(results, "%s{\"shell\":\"%s\",\"ran\":true,\"exit\":%d,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"forks\":%ld,\"matches_mysh\":%s}",
+                    j ? "," : "", shells[j].name, run->exitStatus, run->wall * 1e3, run->cpu * 1e3, run->forks, same ? "true" : "false");
+
+            totalWall[j] += run->wall;
+            totalCpu[j] += run->cpu;
+            totalForks[j] += run->forks;
+            matches[j] += same;
+        }
+
+        printf("\n");
+        fprintf(results, "]}\n");
+    }
+
+    printf("\n%-30s", "total");
+    for (int j = 0; j < numShells; j++) printf(" | %-6s %8.1f %8.1f %6ld %5d", "", totalWall[j] * 1e3, totalCpu[j] * 1e3, totalForks[j], matches[j]);
+    printf("\n\nexit status is shown under each shell's name; same: stdout and exit status equal to mysh's (%d scripts)\n", numScripts);
+    printf("results written to %s\n", argv[2]);
+
+    fclose(results);
+
+    char command[PATH_MAX + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", baseDir);
+    if (system(command) != 0) fprintf(stderr, "could not remove %s\n", baseDir);
+
+    return EXIT_SUCCESS;
+}
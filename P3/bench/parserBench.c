@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define main not_main
+#include "../mysh.c"
+#undef main
+
+/* ns/line and heap allocations/line of the parsing done for every line, calling mysh's functions directly
+   usage: parserBench [results.json]   (run from P3, "make benchParser" does it) */
+
+#define TARGET_NANOS 50000000L // each measurement repeats until it has run this long
+#define MAX_LINE (1 << 20)
+
+/* line of the corpus, built once before the measurements */
+typedef struct {
+    const char *name;
+    char *text;
+} corpusLine;
+
+static char workBuffer[MAX_LINE]; // copy the lexer terminates in place
+
+/* function to get the monotonic time in nanoseconds */
+long long nowNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* function to build a line from a repeated piece: prefix, then count copies of piece, then suffix */
+char *repeatLine(const char *prefix, const char *piece, int count, const char *suffix)
+{
+    size_t length = strlen(prefix) + strlen(piece) * count + strlen(suffix) + 1;
+    if (length > MAX_LINE) return NULL;
+
+    char *line = malloc(length);
+    if (!line) return NULL;
+
+    char *p = line + sprintf(line, "%s", prefix);
+    for (int i = 0; i < count; i++) p += sprintf(p, "%s", piece);
+    sprintf(p, "%s", suffix);
+    return line;
+}
+
+/* what is measured on a line */
+enum { MEASURE_COPY, MEASURE_PARSE, MEASURE_CHAIN, MEASURE_INSHELL };
+
+/* function to run one measurement on a line once */
+void measureOnce(int what, const char *text, size_t length)
+{
+    parsedCommand parsed;
+    char *line = workBuffer;
+
+    switch (what)
+    {
+        case MEASURE_COPY: // the copy every parse measurement starts with, subtracted from them
+            memcpy(workBuffer, text, length + 1);
+            break;
+        case MEASURE_PARSE: // what runCommand does before it dispatches the line
+            memcpy(workBuffer, text, length + 1);
+            arenaReset();
+            if (parseCommandLine(workBuffer, &parsed) == 0 && parsed.stageCount > 0) isBuiltinCommand(parsed.stages[0].commandArgument[0]);
+            break;
+        case MEASURE_CHAIN: // -j: does the line continue the chain before it
+            continuesChain(text);
+            break;
+        case MEASURE_INSHELL: // -j: must the chain run in the shell (it parses a copy of the line)
+            chainRunsInShell(&line, 1);
+            break;
+    }
+}
+
+/* function to measure one function over a line; returns ns per call and sets the heap allocations per call */
+double measure(int what, const char *text, double *allocations)
+{
+    size_t length = strlen(text);
+    if (what == MEASURE_INSHELL) memcpy(workBuffer, text, length + 1); // chainRunsInShell copies it itself
+
+    measureOnce(what, text, length); // warm up: the arena gets its blocks here
+
+    long iterations = 1;
+    long long elapsed = 0;
+    long allocationsBefore = 0;
+
+    while (1)
+    {
+        allocationsBefore = heapAllocations;
+        long long start = nowNanos();
+        for (long i = 0; i < iterations; i++) measureOnce(what, text, length);
+        elapsed = nowNanos() - start;
+
+        if (elapsed >= TARGET_NANOS || iterations >= (1L << 30)) break;
+        iterations = (elapsed > 0 && elapsed < TARGET_NANOS / 16) ? iterations * 16 : iterations * 2;
+    }
+
+    *allocations = (double)(heapAllocations - allocationsBefore) / iterations;
+    return (double)elapsed / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *results = fopen(argc > 1 ? argv[1] : "/dev/null", "w");
+    if (!results)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    quietSyntaxErrors = 1; // adversarial lines may be rejected, only their cost matters
+
+    corpusLine corpus[] = {
+        /* realistic */
+        {"simple", strdup("ls -la /tmp")},
+        {"redirect", strdup("echo hello world > out.txt")},
+        {"pipeline3", strdup("cat < in.txt | grep foo | wc -l")},
+        {"conditional", strdup("and echo build finished")},
+        {"comment", strdup("# nothing but a comment line")},
+        {"trailing#", strdup("make -j 4 all # build everything")},
+        {"prefixed", strdup("time pipesize=64k cat big.log | sort | uniq -c > counts.txt")},
+        {"background", strdup("sleep 10 &")},
+        /* adversarial */
+        {"argv4000", repeatLine("echo", " word", 4000, "")},
+        {"pipes500", repeatLine("echo start", " | cat", 500, "")},
+        {"hashes1000", repeatLine("echo a#b", " x#y#z", 1000, " # trailing ### comment")},
+        {"word64k", repeatLine("echo ", "abcdefgh", 8192, "")},
+        {"spaces16k", repeatLine("   ", "    \t", 4096, "echo spaced")},
+        {"redirects200", repeatLine("cat", " < in > out", 200, "")},
+    };
+    int numLines = sizeof(corpus) / sizeof(corpus[0]);
+
+    const char *names[] = {"copy", "parse", "chain", "inShell"};
+
+    printf("%-14s %8s %14s %14s %14s %14s %12s\n", "line", "bytes", "parse ns", "allocs/line", "ns/byte", "chain ns", "inShell ns");
+
+    for (int i = 0; i < numLines; i++)
+    {
+        if (!corpus[i].text)
+        {
+            printf("%-14s %8s\n", corpus[i].name, "skipped");
+            continue;
+        }
+
+        double ns[4], allocs[4];
+        for (int what = MEASURE_COPY; what <= MEASURE_INSHELL; what++) ns[what] = measure(what, corpus[i].text, &allocs[what]);
+
+        /* the parse measurements start from a fresh copy of the line, which is not part of the parser's cost */
+        double parse = ns[MEASURE_PARSE] - ns[MEASURE_COPY];
+        if (parse < 0) parse = 0;
+        size_t length = strlen(corpus[i].text);
+
+        printf("%-14s %8zu %14.1f %14.3f %14.3f %14.1f %12.1f\n", corpus[i].name, length, parse, allocs[MEASURE_PARSE],
+               parse / length, ns[MEASURE_CHAIN], ns[MEASURE_INSHELL]);
+
+        for (int what = MEASURE_PARSE; what <= MEASURE_INSHELL; what++)
+        {
+            double net = ns[what] - ((what == MEASURE_PARSE) ? ns[MEASURE_COPY] : 0);
+            fprintf(results, "{\"line\":\"%s\",\"bytes\":%zu,\"function\":\"%s\",\"ns_per_line\":%.1f,\"allocations_per_line\":%.3f}\n",
+                    corpus[i].name, length, names[what], net < 0 ? 0 : net, allocs[what]);
+        }
+
+        free(corpus[i].text);
+    }
+
+    fclose(results);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+
+/* throughput of a three stage pipeline of /bin/cat under mysh for each pipe buffer size
+   usage: pipeSize mysh   (run from P3, "make benchPipeSize" does it) */
+
+#define DATA_MB 256 // size of the data pushed through the pipeline
+#define RUNS 3 // best of RUNS is reported
+
+static const char *dataFile = "/tmp/myshPipeSizeData";
+static const char *batchFile = "/tmp/myshPipeSizeBatch.txt";
+
+/* function to write DATA_MB of text lines to dataFile */
+int writeData()
+{
+    int fd = open(dataFile, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+    if (fd < 0)
+    {
+        perror(dataFile);
+        return -1;
+    }
+
+    char block[1 << 16];
+    for (size_t i = 0; i < sizeof(block); i++) block[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+
+    for (int i = 0; i < DATA_MB * 16; i++)
+    {
+        if (write(fd, block, sizeof(block)) != (ssize_t)sizeof(block))
+        {
+            perror("write");
+            close(fd);
+            return -1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+/* function to run mysh on the batch file for one pipe size, returns the wall time in seconds or -1 */
+double runOnce(const char *mysh, const char *size)
+{
+    FILE *batch = fopen(batchFile, "w");
+    if (!batch) return -1;
+
+    /* /bin/cat by path, so every stage is a launched program and not the cat built-in */
+    if (size) fprintf(batch, "pipesize=%s /bin/cat %s | /bin/cat | /bin/cat > /dev/null\n", size, dataFile);
+    else fprintf(batch, "/bin/cat %s | /bin/cat | /bin/cat > /dev/null\n", dataFile);
+    fclose(batch);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execl(mysh, "mysh", batchFile, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s mysh\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *sizes[] = {NULL, "16k", "64k", "256k", "1m"};
+    int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    if (writeData() < 0) return EXIT_FAILURE;
+
+    printf("/bin/cat %d MiB | /bin/cat | /bin/cat > /dev/null, best of %d runs\n\n", DATA_MB, RUNS);
+    printf("%-10s %10s %10s\n", "pipesize", "seconds", "MiB/s");
+
+    for (int i = 0; i < numSizes; i++)
+    {
+        double best = -1;
+
+        for (int run = 0; run < RUNS; run++)
+        {
+            double seconds = runOnce(argv[1], sizes[i]);
+            if (seconds >= 0 && (best < 0 || seconds < best)) best = seconds;
+        }
+
+        if (best < 0) printf("%-10s %10s %10s\n", sizes[i] ? sizes[i] : "default", "failed", "-");
+        else printf("%-10s %10.3f %10.1f\n", sizes[i] ? sizes[i] : "default", best, DATA_MB / best);
+    }
+
+    unlink(dataFile);
+    unlink(batchFile);
+    return 0;
+}
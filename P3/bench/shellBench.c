@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/* commands per second, per-command latency and peak RSS of mysh over generated batch files
+   usage: shellBench mysh results.json [N]   (run from P3, "make bench" does it) */
+
+#define RUNS 3 // best of RUNS is reported for the throughput
+
+static char workDir[] = "/tmp/myshBenchXXXXXX";
+static int numCommands = 2000; // lines in each generated script
+
+/* generated workload */
+typedef struct {
+    const char *name;
+    int (*generate)(FILE *script, int n); // writes the script, returns the number of lines
+} workload;
+
+/* function to write n trivial commands, half of them built-ins and half of them launched programs */
+int generateTrivial(FILE *script, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (i % 2 == 0) fprintf(script, "echo line %d\n", i);
+        else fprintf(script, "/bin/true\n");
+    }
+
+    return n;
+}
+
+/* function to write n 8-stage pipelines */
+int generatePipelines(FILE *script, int n)
+{
+    for (int i = 0; i < n; i++) fprintf(script, "echo pipeline %d | cat | cat | cat | cat | cat | cat | wc -c\n", i);
+    return n;
+}
+
+/* function to write n lines that each redirect STDIN, STDOUT or both, into files of the work directory */
+int generateRedirections(FILE *script, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        switch (i % 4)
+        {
+            case 0: fprintf(script, "echo redirected %d > %s/out%d\n", i, workDir, i % 8); break;
+            case 1: fprintf(script, "cat < %s/out%d > %s/copy%d\n", workDir, (i - 1) % 8, workDir, i % 8); break;
+            case 2: fprintf(script, "wc -c < %s/copy%d > %s/count%d\n", workDir, (i - 1) % 8, workDir, i % 8); break;
+            default: fprintf(script, "pwd > %s/pwd%d\n", workDir, i % 8); break;
+        }
+    }
+
+    return n;
+}
+
+/* function to write n long lines for the lexer: 1000 words each, with comments, operators and long words mixed in */
+int generateLongLines(FILE *script, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(script, "echo");
+        for (int w = 0; w < 1000; w++)
+        {
+            if (w % 100 == 99) fprintf(script, " word%d%s", w, "_with_a_rather_long_tail_to_copy_around_the_lexer");
+            else fprintf(script, " w%d", w);
+        }
+
+        fprintf(script, " > /dev/null # trailing comment %d\n", i);
+    }
+
+    return n;
+}
+
+/* function to compare two latencies for qsort */
+int compareLatency(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* function to run mysh on a script once; STDOUT goes to /dev/null and STDERR to errFile (or /dev/null).
+   With timed set the shell reports every line with MYSH_TIME. Returns the wall time in seconds, or -1; usage gets the shell's resources */
+double runScript(const char *mysh, const char *script, const char *errFile, int timed, struct rusage *usage)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int out = open("/dev/null", O_WRONLY);
+        int err = errFile ? open(errFile, O_WRONLY | O_CREAT | O_TRUNC, 0640) : out;
+        if (out < 0 || err < 0) _exit(127);
+
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+
+        if (timed) setenv("MYSH_TIME", "1", 1);
+        else unsetenv("MYSH_TIME");
+        unsetenv("MYSH_TRACE");
+        unsetenv("MYSH_CHROME_TRACE");
+
+        execl(mysh, "mysh", script, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    if (pid < 0 || wait4(pid, &status, 0, usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) == 127) return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/* function to read the time reports of a run: the latency of a line is the wall time of its pipeline total, or of its only stage.
+   Returns the number of latencies stored (in microseconds, sorted) */
+int readLatencies(const char *errFile, double *latencies, int lines)
+{
+    FILE *reports = fopen(errFile, "r");
+    if (!reports) return 0;
+
+    char *hasTotal = calloc(lines + 1, 1);
+    double *byLine = calloc(lines + 1, sizeof(double));
+    char *seen = calloc(lines + 1, 1);
+    char text[8192];
+
+    while (hasTotal && byLine && seen && fgets(text, sizeof(text), reports))
+    {
+        long line;
+        char stage[16];
+        char *wall = strstr(text, " wall=");
+
+        if (!wall || sscanf(text, "time line=%ld stage=%15s", &line, stage) != 2 || line < 1 || line > lines) continue;
+
+        int total = (strcmp(stage, "total") == 0);
+        if (!total && (hasTotal[line] || strcmp(stage, "1") != 0)) continue;
+
+        byLine[line] = atof(wall + 6) * 1e6;
+        hasTotal[line] |= total;
+        seen[line] = 1;
+    }
+
+    int count = 0;
+    for (int i = 1; seen && i <= lines; i++)
+    {
+        if (seen[i]) latencies[count++] = byLine[i];
+    }
+
+    qsort(latencies, count, sizeof(double), compareLatency);
+
+    free(hasTotal);
+    free(byLine);
+    free(seen);
+    fclose(reports);
+    return count;
+}
+
+/* function to get a percentile of sorted latencies */
+double percentile(const double *sorted, int count, double p)
+{
+    if (count == 0) return 0;
+
+    int index = (int)(p / 100 * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s mysh results.json [N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *mysh = argv[1];
+    if (argc > 3) numCommands = atoi(argv[3]);
+    if (numCommands < 1) numCommands = 1;
+
+    if (!mkdtemp(workDir))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    FILE *results = fopen(argv[2], "w");
+    if (!results)
+    {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    workload workloads[] = {
+        {"trivial", generateTrivial},
+        {"pipeline8", generatePipelines},
+        {"redirection", generateRedirections},
+        {"longlines", generateLongLines},
+    };
+    int numWorkloads = sizeof(workloads) / sizeof(workloads[0]);
+    int failed = 0;
+
+    printf("%d lines per script, best of %d runs\n\n", numCommands, RUNS);
+    printf("%-12s %10s %12s %10s %10s %12s\n", "workload", "seconds", "commands/s", "p50 us", "p99 us", "peak RSS KB");
+
+    for (int i = 0; i < numWorkloads; i++)
+    {
+        char script[64], errFile[64];
+        snprintf(script, sizeof(script), "%s/%s.txt", workDir, workloads[i].name);
+        snprintf(errFile, sizeof(errFile), "%s/%s.time", workDir, workloads[i].name);
+
+        FILE *file = fopen(script, "w");
+        if (!file)
+        {
+            perror(script);
+            failed = 1;
+            continue;
+        }
+
+        int lines = workloads[i].generate(file, numCommands);
+        fclose(file);
+
+        /* throughput and peak RSS without any reporting, then the latency of every line from a timed run */
+        double best = -1;
+        long peakRss = 0;
+
+        for (int run = 0; run < RUNS; run++)
+        {
+            struct rusage usage;
+            double seconds = runScript(mysh, script, NULL, 0, &usage);
+            if (seconds >= 0 && (best < 0 || seconds < best)) best = seconds;
+            if (seconds >= 0 && usage.ru_maxrss > peakRss) peakRss = usage.ru_maxrss;
+        }
+
+        struct rusage usage;
+        double *latencies = malloc(sizeof(double) * lines);
+        int count = (latencies && runScript(mysh, script, errFile, 1, &usage) >= 0) ? readLatencies(errFile, latencies, lines) : 0;
+
+        if (best < 0 || count == 0)
+        {
+            printf("%-12s %10s\n", workloads[i].name, "failed");
+            failed = 1;
+            free(latencies);
+            continue;
+        }
+
+        double p50 = percentile(latencies, count, 50), p99 = percentile(latencies, count, 99);
+        printf("%-12s %10.3f %12.0f %10.1f %10.1f %12ld\n", workloads[i].name, best, lines / best, p50, p99, peakRss);
+
+        fprintf(results, "{\"workload\":\"%s\",\"commands\":%d,\"seconds\":%.6f,\"commands_per_sec\":%.1f,"
+                "\"p50_us\":%.1f,\"p99_us\":%.1f,\"latency_samples\":%d,\"peak_rss_kb\":%ld}\n",
+                workloads[i].name, lines, best, lines / best, p50, p99, count, peakRss);
+
+        free(latencies);
+        unlink(errFile);
+        unlink(script);
+    }
+
+    fclose(results);
+    printf("\nresults written to %s\n", argv[2]);
+
+    /* the files the redirection workload wrote */
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", workDir);
+    if (system(command) != 0) fprintf(stderr, "could not remove %s\n", workDir);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -7,10 +7,23 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <spawn.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
 
 #define BUFSIZE 4096
-#define MAX_ARGS 100
-#define MAX_PIPES 100
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+#define OUTPUT_BUFSIZE 65536
+#define ARENA_CHUNK 65536
+#define ARENA_ALIGN 16
 
 static int interactive;
 static int lastStatus = -1;
@@ -18,6 +31,31 @@ static char *commandBuffer = NULL;
 static int dieFlag = 0;
 static int shellStatus = 0;
 static int dieExecuted = 0; 
+static int parallelSlots = 1; // -j N: independent chains of a batch file run on up to N processes
+static int keepOrder = 0; // -k: the output of -j chains comes out in script order
+static long orderMemoryLimit = 1 << 20; // -k output held in memory per stream before it spills to a temporary file
+static int quietSyntaxErrors = 0; // set while a line is only being inspected, its errors are reported when it runs
+static int launchingJob = 0; // set while a background job is launched, its first stage reads /dev/null
+static int builtinStdin = 0; // set while STDIN is real input for a built-in (redirected, or a pipeline child); otherwise batch mode gives it none
+static int timeAll = 0; // set time=on or MYSH_TIME=1: every line reports what it used, as if it began with time
+static long lineNumber = 0; // line of the input being run, counted from 1
+static char outputBuffer[OUTPUT_BUFSIZE]; // shell-owned STDOUT buffer, flushed before external commands run and at exit
+
+extern char **environ;
+
+/* backends used to launch external commands (selected with MYSH_SPAWN=spawn|fork) */
+enum { SPAWN_POSIX, SPAWN_FORK };
+static int spawnBackend = SPAWN_POSIX;
+
+/* pipe buffer size applied with F_SETPIPE_SZ to every pipe the shell creates */
+static long pipeSize = 0; // requested size in bytes, 0 keeps the kernel default
+static long pipeSizeGranted = 0; // size the kernel actually grants for it
+
+/* directories searched for bare command names, taken from PATH */
+static char *searchPath = NULL; // copy of the PATH value the index was built from
+static char *searchPathSplit = NULL; // second copy of it, split in place into the directories below
+static char **searchDirectories = NULL;
+static int numSearchDirs = 0;
 
 /* data structure to hold command line information (the entire line, its input/output if redirection is present) */
 typedef struct {
@@ -26,6 +64,120 @@ typedef struct {
     char* outputFile; // STDOUT
 } commandPacket; 
 
+/* conditional prefix of a command line */
+enum { COND_NONE, COND_AND, COND_OR };
+
+/* a parsed command line: its conditional prefix and the stages of its pipeline (a simple command is a pipeline of one stage) */
+typedef struct {
+    int conditional; // COND_NONE, COND_AND or COND_OR
+    commandPacket *stages; // stages in order, every string points into the line itself
+    int stageCount; // number of stages, 0 for an empty line
+    long pipeSize; // pipe buffer size for this line, 0 keeps the kernel default
+    int timed; // set by a leading time word (or time=on), each stage reports the resources it used
+    int background; // set by a trailing &, the line runs as a job
+} parsedCommand;
+
+/* block of the per-line arena; blocks are kept when the arena is reset so steady state needs no heap allocation */
+typedef struct arenaChunk {
+    struct arenaChunk *next; // next block of the arena
+    size_t size; // bytes available in data
+    size_t used; // bytes handed out since the last reset
+    char data[]; // the memory itself
+} arenaChunk;
+
+static arenaChunk *arenaHead = NULL; // first block of the arena
+static arenaChunk *arenaCurrent = NULL; // block allocations are currently taken from
+static long heapAllocations = 0; // malloc/realloc calls made by the shell itself
+
+/* entry of the search path index (bare name -> first PATH directory holding an executable of that name) */
+typedef struct {
+    size_t nameOffset; // name of the executable inside indexNames
+    int dir; // index into searchDirectories, -1 for an empty slot
+    int hits; // number of times the entry was used
+} indexEntry;
+
+static indexEntry *pathIndex = NULL; // open addressing table, capacity is a power of two
+static size_t indexCapacity = 0;
+static size_t indexCount = 0;
+static char *indexNames = NULL; // every indexed name, NUL terminated, back to back
+static size_t indexNamesUsed = 0;
+static size_t indexNamesCapacity = 0;
+static int indexValid = 0;
+static long indexBuildMicros = 0; // how long the last build took
+static struct timespec *searchDirTimes = NULL; // mtimes of the search directories when the index was built
+static long hashHits = 0; // lookups answered by the index
+static long hashMisses = 0; // lookups for names that are not in the index
+static long commandEpoch = 0; // incremented once per command line
+static long validatedEpoch = -1; // epoch in which PATH and the directory mtimes were last checked
+
+/* function to allocate heap memory for the shell, counted in heapAllocations */
+void *shellMalloc(size_t size)
+{
+    heapAllocations++;
+    return malloc(size);
+}
+
+/* function to resize heap memory for the shell, counted in heapAllocations */
+void *shellRealloc(void *pointer, size_t size)
+{
+    heapAllocations++;
+    return realloc(pointer, size);
+}
+
+/* function to copy a string onto the heap, counted in heapAllocations */
+char *shellStrdup(const char *string)
+{
+    size_t length = strlen(string) + 1;
+    char *copy = shellMalloc(length);
+    if (copy) memcpy(copy, string, length);
+    return copy;
+}
+
+/* function to hand out memory that lives until the next arenaReset(), nothing is freed individually */
+void *arenaAlloc(size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    /* use the current block, or the first later block that is large enough */
+    for (arenaChunk *chunk = arenaCurrent; chunk != NULL; chunk = chunk->next)
+    {
+        if (chunk->size - chunk->used >= size)
+        {
+            void *memory = chunk->data + chunk->used;
+            chunk->used += size;
+            arenaCurrent = chunk;
+            return memory;
+        }
+    }
+
+    /* no block fits: add one at the end of the list */
+    size_t chunkSize = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+    arenaChunk *chunk = shellMalloc(sizeof(arenaChunk) + chunkSize);
+    if (!chunk) return NULL;
+
+    chunk->next = NULL;
+    chunk->size = chunkSize;
+    chunk->used = size;
+
+    if (arenaHead == NULL) arenaHead = chunk;
+    else
+    {
+        arenaChunk *last = arenaHead;
+        while (last->next) last = last->next;
+        last->next = chunk;
+    }
+
+    arenaCurrent = chunk;
+    return chunk->data;
+}
+
+/* function to release everything allocated from the arena at once, the blocks themselves are kept */
+void arenaReset()
+{
+    for (arenaChunk *chunk = arenaHead; chunk != NULL; chunk = chunk->next) chunk->used = 0;
+    arenaCurrent = arenaHead;
+}
+
 /* welcome message for interactive mode */
 void printWelcome() { printf("Welcome to my shell!\n"); }
 
@@ -55,8 +207,8 @@ int runBatchFile(char *batchFile)
 /* when mysh is reading commands from a non-terminal standard input, any child processes it launches will redirect standard input to /dev/null */
 void applyDevNullIfBatchNoInput() {
 
-    /* redirect standard input to /dev/null for non-terminal standard input */
-    if (!interactive) {
+    /* redirect standard input to /dev/null for non-terminal standard input, and for background jobs */
+    if (!interactive || launchingJob) {
         int devnull = open("/dev/null", O_RDONLY);
 
         if (devnull >= 0) {
@@ -66,6 +218,303 @@ void applyDevNullIfBatchNoInput() {
     }
 }
 
+/* function to check whether a command is a built-in that also exists as a program (which still reports the program) */
+int isUtilityBuiltin(const char *command)
+{
+    return strcmp(command, "echo") == 0 || strcmp(command, "printf") == 0 || strcmp(command, "true") == 0 || strcmp(command, "false") == 0 || strcmp(command, "cat") == 0;
+}
+
+/* function to check whether a command name is one of the shell's built-ins */
+int isBuiltinCommand(const char *command)
+{
+    return strcmp(command, "cd") == 0 || strcmp(command, "pwd") == 0 || strcmp(command, "which") == 0 || strcmp(command, "exit") == 0 || strcmp(command, "die") == 0 || strcmp(command, "hash") == 0 || strcmp(command, "memstats") == 0 || strcmp(command, "set") == 0 || strcmp(command, "jobs") == 0 || strcmp(command, "wait") == 0 || strcmp(command, "parallel") == 0 || strcmp(command, "xargs") == 0 || isUtilityBuiltin(command);
+}
+
+/* function to hash a command name for the search path index */
+unsigned int hashName(const char *name)
+{
+    unsigned int h = 5381;
+    while (*name) h = h * 33 + (unsigned char)*name++;
+    return h;
+}
+
+/* function to return the PATH mysh searches */
+char *currentPath()
+{
+    char *path = getenv("PATH");
+    return (path != NULL) ? path : DEFAULT_PATH;
+}
+
+/* function to free the search path index and the directory list it was built from */
+void freePathIndex()
+{
+    free(pathIndex);
+    free(indexNames);
+    free(searchDirectories);
+    free(searchDirTimes);
+    free(searchPath);
+    free(searchPathSplit);
+
+    pathIndex = NULL;
+    indexNames = NULL;
+    searchDirectories = NULL;
+    searchDirTimes = NULL;
+    searchPath = NULL;
+    searchPathSplit = NULL;
+    indexCapacity = indexCount = indexNamesUsed = indexNamesCapacity = 0;
+    numSearchDirs = 0;
+    indexValid = 0;
+}
+
+/* function to find the slot of name in the index: either its entry or the empty slot where it belongs */
+indexEntry *probePathIndex(const char *name)
+{
+    size_t mask = indexCapacity - 1;
+    size_t i = hashName(name) & mask;
+
+    while (pathIndex[i].dir >= 0 && strcmp(indexNames + pathIndex[i].nameOffset, name) != 0) i = (i + 1) & mask;
+
+    return &pathIndex[i];
+}
+
+/* function to double the index table, keeping the load factor under one half */
+int growPathIndex()
+{
+    size_t oldCapacity = indexCapacity;
+    indexEntry *old = pathIndex;
+
+    indexCapacity = oldCapacity ? oldCapacity * 2 : 1024;
+    pathIndex = shellMalloc(sizeof(indexEntry) * indexCapacity);
+    if (!pathIndex)
+    {
+        pathIndex = old;
+        indexCapacity = oldCapacity;
+        return -1;
+    }
+
+    for (size_t i = 0; i < indexCapacity; i++) pathIndex[i].dir = -1;
+
+    for (size_t i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].dir >= 0) *probePathIndex(indexNames + old[i].nameOffset) = old[i];
+    }
+
+    free(old);
+    return 0;
+}
+
+/* function to add an executable to the index, directories earlier in PATH win */
+void addToPathIndex(const char *name, int dir)
+{
+    if ((indexCount + 1) * 2 > indexCapacity && growPathIndex() < 0) return;
+
+    indexEntry *slot = probePathIndex(name);
+    if (slot->dir >= 0) return; // already found in an earlier directory
+
+    size_t length = strlen(name) + 1;
+    if (indexNamesUsed + length > indexNamesCapacity)
+    {
+        size_t capacity = indexNamesCapacity ? indexNamesCapacity : 16384;
+        while (indexNamesUsed + length > capacity) capacity *= 2;
+
+        char *temp = shellRealloc(indexNames, capacity);
+        if (!temp) return;
+
+        indexNames = temp;
+        indexNamesCapacity = capacity;
+    }
+
+    memcpy(indexNames + indexNamesUsed, name, length);
+    slot->nameOffset = indexNamesUsed;
+    slot->dir = dir;
+    slot->hits = 0;
+
+    indexNamesUsed += length;
+    indexCount++;
+}
+
+/* function to read every PATH directory once and index the executables it holds */
+void buildPathIndex()
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    freePathIndex();
+
+    /* split a copy of PATH into its directories, empty entries are skipped */
+    searchPath = shellStrdup(currentPath());
+    searchPathSplit = shellStrdup(currentPath());
+    if (!searchPath || !searchPathSplit) return;
+
+    int maxDirs = 1;
+    for (char *c = searchPath; *c; c++) if (*c == ':') maxDirs++;
+
+    searchDirectories = shellMalloc(sizeof(char *) * (maxDirs + 1));
+    searchDirTimes = shellMalloc(sizeof(struct timespec) * maxDirs);
+    if (!searchDirectories || !searchDirTimes) return;
+    memset(searchDirTimes, 0, sizeof(struct timespec) * maxDirs);
+
+    char *saveptr;
+    for (char *dir = strtok_r(searchPathSplit, ":", &saveptr); dir != NULL; dir = strtok_r(NULL, ":", &saveptr)) searchDirectories[numSearchDirs++] = dir;
+    searchDirectories[numSearchDirs] = NULL;
+
+    if (growPathIndex() < 0) return;
+
+    for (int i = 0; i < numSearchDirs; i++)
+    {
+        struct stat st;
+        if (stat(searchDirectories[i], &st) == 0) searchDirTimes[i] = st.st_mtim;
+
+        DIR *dir = opendir(searchDirectories[i]);
+        if (!dir) continue;
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            /* only regular files this process may execute are indexed */
+            if (fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+            if (faccessat(dirfd(dir), entry->d_name, X_OK, 0) != 0) continue;
+
+            addToPathIndex(entry->d_name, i);
+        }
+
+        closedir(dir);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    indexBuildMicros = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+    indexValid = 1;
+}
+
+/* function to rebuild the index if PATH or a search directory changed since it was built; checked at most once per command line */
+void validatePathIndex()
+{
+    if (indexValid && validatedEpoch == commandEpoch) return;
+    validatedEpoch = commandEpoch;
+
+    if (!indexValid || strcmp(searchPath, currentPath()) != 0)
+    {
+        buildPathIndex();
+        return;
+    }
+
+    for (int i = 0; i < numSearchDirs; i++)
+    {
+        struct stat st;
+        struct timespec mtime = {0, 0};
+        if (stat(searchDirectories[i], &st) == 0) mtime = st.st_mtim;
+
+        if (mtime.tv_sec != searchDirTimes[i].tv_sec || mtime.tv_nsec != searchDirTimes[i].tv_nsec)
+        {
+            buildPathIndex();
+            return;
+        }
+    }
+}
+
+/* function to find the executable mysh would run for command, stores it in path; returns 0 on success */
+int findExecutable(const char *command, char *path, size_t size)
+{
+    /* names containing a slash are used as they stand */
+    if (strchr(command, '/') != NULL)
+    {
+        snprintf(path, size, "%s", command);
+        return access(command, X_OK) == 0 ? 0 : -1;
+    }
+
+    /* bare names are a single probe into the search path index */
+    validatePathIndex();
+    if (!indexValid) return -1;
+
+    indexEntry *entry = probePathIndex(command);
+    if (entry->dir < 0)
+    {
+        hashMisses++;
+        return -1;
+    }
+
+    entry->hits++;
+    hashHits++;
+    snprintf(path, size, "%s/%s", searchDirectories[entry->dir], command);
+    return 0;
+}
+
+/* function for the hash built-in: list the commands used so far, -r forgets them, -s prints hit/miss counts, -i describes the search path index */
+int runHash(int argc, char *argv[])
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "hash: Too many arguments.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "-r") == 0)
+    {
+        freePathIndex(); // rebuilt on the next lookup
+        return 0;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "-s") == 0)
+    {
+        printf("hits: %ld\n", hashHits);
+        printf("misses: %ld\n", hashMisses);
+        return 0;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "-i") == 0)
+    {
+        validatePathIndex();
+
+        size_t bytes = indexCapacity * sizeof(indexEntry) + indexNamesCapacity;
+        printf("directories: %d\n", numSearchDirs);
+        printf("commands: %zu\n", indexCount);
+        printf("bytes: %zu\n", bytes);
+        printf("build time: %ld us\n", indexBuildMicros);
+        return 0;
+    }
+
+    if (argc == 2)
+    {
+        fprintf(stderr, "hash: usage: hash [-r | -s | -i]\n");
+        return EXIT_FAILURE;
+    }
+
+    int empty = 1;
+    for (size_t i = 0; i < indexCapacity; i++)
+    {
+        if (pathIndex[i].dir < 0 || pathIndex[i].hits == 0) continue;
+
+        if (empty) printf("hits\tcommand\n");
+        empty = 0;
+        printf("%4d\t%s/%s\n", pathIndex[i].hits, searchDirectories[pathIndex[i].dir], indexNames + pathIndex[i].nameOffset);
+    }
+
+    if (empty) printf("hash: hash table empty\n");
+    return 0;
+}
+
+/* function for the memstats built-in: how often the shell has called the heap and how large the per-line arena is */
+int runMemstats(int argc)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "memstats: Too many arguments.\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t blocks = 0, bytes = 0;
+    for (arenaChunk *chunk = arenaHead; chunk != NULL; chunk = chunk->next)
+    {
+        blocks++;
+        bytes += chunk->size;
+    }
+
+    printf("heap allocations: %ld\n", heapAllocations);
+    printf("arena blocks: %zu\n", blocks);
+    printf("arena bytes: %zu\n", bytes);
+    return 0;
+}
+
 int runPWD(int argc)
 {
     if (argc > 1)
@@ -134,695 +583,3450 @@ int runCD(int argc, char *argv[])
 
 int runWhich(char *filename)
 {
-    char *directories[] = {"/usr/local/bin", "/usr/bin", "/bin", NULL}; // the only directories we will be searching for
     char path[BUFSIZE];
 
-    pid_t pid = fork();
+    /* fail if we are given a built-in command as argument (echo, printf, true and false are also programs) */
+    if (isBuiltinCommand(filename) && !isUtilityBuiltin(filename)) return EXIT_FAILURE;
 
-    /* create new process to be executed while the original process gathers its info */
-    if (pid == 0)
-    { // child process
-        /* terminate program if we are given a built-in command as argument */
-        if ((strcmp(filename, "cd") == 0) || (strcmp(filename, "pwd") == 0) || (strcmp(filename, "which") == 0) || (strcmp(filename, "exit") == 0) || (strcmp(filename, "die") == 0))
-            exit(EXIT_FAILURE);
-
-        /* check if program is passable as it stands */
-        if (access(filename, X_OK) == 0)
-        {
-            printf("%s\n", filename);
-            fflush(stdout);
+    /* look the program up the same way mysh does before running it, no child process is needed */
+    if (findExecutable(filename, path, sizeof(path)) != 0) return EXIT_FAILURE;
 
-            exit(EXIT_SUCCESS);
-        }
+    printf("%s\n", path);
+    return EXIT_SUCCESS;
+}
 
-        /* another check if program is a bare name and passable by appending specified directories */
-        for (int i = 0; directories[i] != NULL; i++)
-        {
-            snprintf(path, sizeof(path), "%s/%s", directories[i], filename); // builds new path
+/* function to write the character for the escape sequence starting at p (just after the backslash); returns the number of characters used, sets *stop for \c. echoStyle selects the \0NNN octal form of echo and %b */
+int writeEscape(const char *p, int echoStyle, int *stop)
+{
+    int value = 0, used = 0;
 
-            if (access(path, X_OK) == 0)
+    switch (*p)
+    {
+        case 'a': putchar('\a'); return 1;
+        case 'b': putchar('\b'); return 1;
+        case 'c': *stop = 1; return 1;
+        case 'e': putchar(033); return 1;
+        case 'f': putchar('\f'); return 1;
+        case 'n': putchar('\n'); return 1;
+        case 'r': putchar('\r'); return 1;
+        case 't': putchar('\t'); return 1;
+        case 'v': putchar('\v'); return 1;
+        case '\\': putchar('\\'); return 1;
+        case 'x': // \xHH
+            while (used < 2 && isxdigit((unsigned char)p[1 + used]))
             {
-                printf("%s\n", path);
-                fflush(stdout);
-
-                exit(EXIT_SUCCESS);
+                char c = p[1 + used++];
+                value = value * 16 + (isdigit((unsigned char)c) ? c - '0' : tolower((unsigned char)c) - 'a' + 10);
             }
-        }
-
-        exit(EXIT_FAILURE);
+            if (used == 0)
+            {
+                putchar('\\');
+                return 0; // not an escape, the x is written as it is
+            }
+            putchar(value);
+            return 1 + used;
+        default:
+            break;
     }
-    else if (pid > 0)
-    { // parent process
-        /* wait until child process terminates and gather its exit code */
-        int status;
-        waitpid(pid, &status, 0);
 
-        return WEXITSTATUS(status);
+    /* octal: \0NNN for echo and %b, \NNN for printf formats */
+    int skip = 0;
+    if (echoStyle)
+    {
+        if (*p != '0') { putchar('\\'); return 0; }
+        skip = 1;
     }
-    else
-    { // fork could not be created
-        perror("fork");
-        return EXIT_FAILURE; // FAILED
+    else if (*p < '0' || *p > '7')
+    {
+        putchar('\\');
+        return 0;
     }
+
+    while (used < 3 && p[skip + used] >= '0' && p[skip + used] <= '7') value = value * 8 + (p[skip + used++] - '0');
+    putchar(value & 0xff);
+    return skip + used;
 }
 
-int runExit()
+/* function to write s, expanding backslash escapes; returns 1 if \c asked to stop all output */
+int writeEscaped(const char *s, int echoStyle)
 {
-    if (interactive)
+    int stop = 0;
+
+    for (const char *p = s; *p && !stop; p++)
     {
-        printGoodbye();
-        fflush(stdout);
+        if (*p != '\\' || p[1] == '\0')
+        {
+            putchar(*p);
+            continue;
+        }
+
+        p += writeEscape(p + 1, echoStyle, &stop);
     }
 
-    exit(EXIT_SUCCESS);
+    return stop;
 }
 
-int runDie(const int argc, char **argv)
+/* function for the echo built-in, same options as the echo program: -n (no newline), -e (escapes), -E (no escapes) */
+int runEcho(int argc, char *argv[])
 {
-    if (argv != NULL) {
-        for (int i = 1; i < argc; i++)
+    int newline = 1, escapes = 0, i = 1;
+
+    /* leading arguments made only of n, e and E letters are options */
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1)) break;
+
+        for (char *c = argv[i] + 1; *c; c++)
         {
-            printf("%s ", argv[i]);
+            if (*c == 'n') newline = 0;
+            else if (*c == 'e') escapes = 1;
+            else escapes = 0;
         }
-        printf("\n");
-
-        fflush(stdout);
     }
 
-    dieFlag = 1;
-    shellStatus = 1;
-
-    if (interactive)
+    for (int first = i; i < argc; i++)
     {
-        printGoodbye();
-        fflush(stdout);
+        if (i > first) putchar(' ');
+
+        if (!escapes) fputs(argv[i], stdout);
+        else if (writeEscaped(argv[i], 1)) return 0; // \c ends the output
     }
-    exit(EXIT_FAILURE);
-}
 
-/* functino to strip comments from the given line */
-void stripComments(char *line)
-{
-    char *p = strchr(line, '#'); // address of the start of a comment
-    if (p) *p = '\0'; // terminate string at this location
+    if (newline) putchar('\n');
+    return ferror(stdout) ? EXIT_FAILURE : 0;
 }
 
-/* function to remove whitespace from the string */
-char *trimWhitespace(char *s)
+/* function to convert a printf argument to a number; 'c and "c give the character code */
+long long printfNumber(const char *arg, int *status)
 {
-    while (isspace((unsigned char)*s)) s++; // removes preceeding whitespace
+    if (arg == NULL) return 0;
+    if (arg[0] == '\'' || arg[0] == '"') return (unsigned char)arg[1];
 
-    if (*s == '\0') return s; // returns empty string
+    char *end;
+    long long value = strtoll(arg, &end, 0);
 
-    /* removes trailing whitespace */
-    char *end = s + strlen(s) - 1;
-    while (end > s && isspace((unsigned char)*end)) end--;
+    if (*arg == '\0' || *end != '\0')
+    {
+        fprintf(stderr, "printf: '%s': expected a numeric value\n", arg);
+        *status = EXIT_FAILURE;
+    }
 
-    *(end + 1) = '\0';
-    return s;
+    return value;
 }
 
-/* function to parse each segement into array of tokens */
-char **tokenize(char *line, int *count)
+/* function for the printf built-in: printf FORMAT [ARGUMENT]..., the format is reused while arguments remain */
+int runPrintf(int argc, char *argv[])
 {
-    /* features to be implemented */
-    int capacity = 10;
-    char **tokens = malloc(sizeof(char *) * capacity);
-    *count = 0;
+    if (argc < 2)
+    {
+        fprintf(stderr, "printf: missing operand\n");
+        return EXIT_FAILURE;
+    }
+
+    char *format = argv[1];
+    int next = 2, status = 0;
+
+    do
+    {
+        int start = next; // to notice a format that uses no arguments
+
+        for (char *p = format; *p; p++)
+        {
+            if (*p == '\\')
+            {
+                int stop = 0;
+                if (p[1] == '\0') { putchar('\\'); break; }
+                p += writeEscape(p + 1, 0, &stop);
+                if (stop) return status;
+                continue;
+            }
+
+            if (*p != '%')
+            {
+                putchar(*p);
+                continue;
+            }
+
+            if (p[1] == '%')
+            {
+                putchar('%');
+                p++;
+                continue;
+            }
+
+            /* copy the directive's flags, width and precision into a C format */
+            char spec[64];
+            int length = 0;
+            spec[length++] = '%';
+            p++;
+
+            while (*p && strchr("-+ #0", *p) && length < 40) spec[length++] = *p++;
+
+            for (int part = 0; part < 2; part++)
+            {
+                if (part == 1)
+                {
+                    if (*p != '.') break;
+                    spec[length++] = *p++;
+                }
+
+                if (*p == '*')
+                {
+                    char *arg = next < argc ? argv[next++] : NULL;
+                    long long value = printfNumber(arg, &status);
+
+                    if (value < INT_MIN || value > INT_MAX || (part == 0 && value == INT_MIN))
+                    {
+                        fprintf(stderr, "printf: '%s': value out of range\n", arg);
+                        return EXIT_FAILURE;
+                    }
+
+                    /* a negative precision is the same as none, a negative width is the - flag */
+                    if (value < 0 && part == 1)
+                    {
+                        length--; // the '.'
+                        p++;
+                        continue;
+                    }
+
+                    if (value < 0)
+                    {
+                        spec[length++] = '-';
+                        value = -value;
+                    }
+
+                    char number[24];
+                    int digits = snprintf(number, sizeof(number), "%lld", value);
+
+                    /* the spec must keep room for ll, the conversion and the NUL */
+                    if (length + digits > 50)
+                    {
+                        fprintf(stderr, "printf: conversion specification too long\n");
+                        return EXIT_FAILURE;
+                    }
+
+                    memcpy(spec + length, number, digits);
+                    length += digits;
+                    p++;
+                }
+                else
+                {
+                    while (isdigit((unsigned char)*p) && length < 50) spec[length++] = *p++;
+                }
+            }
+
+            char conversion = *p;
+            char *arg = next < argc ? argv[next] : NULL;
+
+            if (conversion == '\0')
+            {
+                spec[length] = '\0';
+                fprintf(stderr, "printf: %s: invalid conversion specification\n", spec);
+                return EXIT_FAILURE;
+            }
+
+            if (strchr("diouxXcsbeEfgG", conversion) == NULL)
+            {
+                fprintf(stderr, "printf: %%%c: invalid conversion specification\n", conversion);
+                return EXIT_FAILURE;
+            }
+
+            next += (next < argc);
+
+            if (conversion == 'b')
+            {
+                if (arg != NULL && writeEscaped(arg, 1)) return status;
+                continue;
+            }
+
+            if (conversion == 's' || conversion == 'c')
+            {
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                if (conversion == 's') printf(spec, arg ? arg : "");
+                else printf(spec, arg ? arg[0] : '\0');
+                continue;
+            }
+
+            if (strchr("eEfgG", conversion))
+            {
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                printf(spec, arg ? strtod(arg, NULL) : 0.0);
+                continue;
+            }
+
+            spec[length++] = 'l';
+            spec[length++] = 'l';
+            spec[length++] = conversion;
+            spec[length] = '\0';
+            printf(spec, printfNumber(arg, &status));
+        }
+
+        if (next == start) break; // format takes no arguments
+    } while (next < argc);
+
+    return ferror(stdout) ? EXIT_FAILURE : status;
+}
+
+int runExit()
+{
+    if (interactive)
+    {
+        printGoodbye();
+        fflush(stdout);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+int runDie(const int argc, char **argv)
+{
+    if (argv != NULL) {
+        for (int i = 1; i < argc; i++)
+        {
+            printf("%s ", argv[i]);
+        }
+        printf("\n");
+
+        fflush(stdout);
+    }
+
+    dieFlag = 1;
+    shellStatus = 1;
+
+    if (interactive)
+    {
+        printGoodbye();
+        fflush(stdout);
+    }
+    exit(EXIT_FAILURE);
+}
+
+/* function to report a syntax error found by the lexer */
+int reportSyntaxError(const char *message)
+{
+    if (!quietSyntaxErrors) fprintf(stderr, "Error: %s\n", message);
+    return -1;
+}
+
+/* function to open the next stage of a parsed line, its argv starts at the given word */
+commandPacket *startStage(parsedCommand *parsed, char **words)
+{
+    commandPacket *stage = &parsed->stages[parsed->stageCount++];
+
+    stage->commandArgument = words;
+    stage->inputFile = NULL;
+    stage->outputFile = NULL;
+
+    return stage;
+}
+
+/* function to parse a command line in a single pass: words are NUL terminated in place and every node points into the line or the arena.
+   Returns 0 on success, -1 (after printing an error) on a syntax error */
+int parseCommandLine(char *line, parsedCommand *parsed)
+{
+    /* size the arrays for the worst case from the arena, so they never move: every word takes at least 1 character
+       and 1 separator, and every stage adds one NULL to the word array */
+    size_t length = strlen(line);
+    char **lexWords = arenaAlloc(sizeof(char *) * (length + 2));
+
+    parsed->conditional = COND_NONE;
+    parsed->stages = arenaAlloc(sizeof(commandPacket) * (length / 2 + 2));
+    parsed->stageCount = 0;
+    parsed->background = 0;
+
+    if (!lexWords || !parsed->stages) return reportSyntaxError("Memory allocation failed.");
+
+    size_t wordCount = 0; // words stored in lexWords so far
+    commandPacket *stage = NULL; // stage being filled, NULL between stages
+    int stageWords = 0; // words in the current stage
+    char **pendingFile = NULL; // set by < or > until the file name arrives
+    char held = 0; // delimiter that was overwritten by the NUL ending the previous word
+    char *p = line;
+
+    while (1)
+    {
+        char c;
+
+        if (held)
+        {
+            c = held;
+            held = 0;
+        }
+        else
+        {
+            while (isspace((unsigned char)*p)) p++;
+            c = *p;
+            if (c == '\0') break;
+            p++;
+        }
+
+        if (c == '#') break; // the rest of the line is a comment
+
+        if (c == '&') // the line runs in the background; only a comment may follow
+        {
+            if (pendingFile) return reportSyntaxError("missing file name for redirection.");
+            if (stage == NULL || stageWords == 0) return reportSyntaxError("missing command.");
+
+            while (isspace((unsigned char)*p)) p++;
+            if (*p != '\0' && *p != '#') return reportSyntaxError("'&' must end the command line.");
+
+            parsed->background = 1;
+            break;
+        }
+
+        if (c == '|' || c == '<' || c == '>')
+        {
+            if (pendingFile) return reportSyntaxError("missing file name for redirection.");
+
+            if (c == '|')
+            {
+                if (stage == NULL || stageWords == 0) return reportSyntaxError("empty command in pipeline.");
+
+                lexWords[wordCount++] = NULL; // terminate this stage's argv
+                stage = NULL;
+                continue;
+            }
+
+            if (stage == NULL)
+            {
+                stage = startStage(parsed, &lexWords[wordCount]);
+                stageWords = 0;
+            }
+
+            pendingFile = (c == '<') ? &stage->inputFile : &stage->outputFile;
+            continue;
+        }
+
+        /* a word runs until whitespace, an operator or a comment */
+        char *word = p - 1;
+        while (*p != '\0' && !isspace((unsigned char)*p) && *p != '|' && *p != '<' && *p != '>' && *p != '&' && *p != '#') p++;
+
+        if (*p != '\0')
+        {
+            if (!isspace((unsigned char)*p)) held = *p;
+            *p++ = '\0';
+        }
+
+        if (pendingFile)
+        {
+            *pendingFile = word;
+            pendingFile = NULL;
+            continue;
+        }
+
+        int isConditional = strcmp(word, "and") == 0 || strcmp(word, "or") == 0;
+
+        /* a leading and/or is the conditional prefix of the whole line */
+        if (isConditional && stage == NULL && parsed->stageCount == 0 && parsed->conditional == COND_NONE)
+        {
+            parsed->conditional = (word[0] == 'a') ? COND_AND : COND_OR;
+            continue;
+        }
+
+        if (stage == NULL)
+        {
+            stage = startStage(parsed, &lexWords[wordCount]);
+            stageWords = 0;
+        }
+
+        if (isConditional && stageWords == 0 && parsed->stageCount > 1) return reportSyntaxError("conditional operators cannot appear inside a pipeline.");
+
+        lexWords[wordCount++] = word;
+        stageWords++;
+    }
+
+    if (pendingFile) return reportSyntaxError("missing file name for redirection.");
+
+    if (stage == NULL && parsed->stageCount > 0) return reportSyntaxError("empty command in pipeline.");
+
+    if (stage != NULL)
+    {
+        if (stageWords == 0) return reportSyntaxError("missing command.");
+        lexWords[wordCount++] = NULL;
+    }
+
+    return 0;
+}
+
+/* function to select the launch backend for external commands from the environment */
+void selectSpawnBackend()
+{
+    char *backend = getenv("MYSH_SPAWN");
+
+    spawnBackend = SPAWN_POSIX;
+    if (backend != NULL && strcmp(backend, "fork") == 0) spawnBackend = SPAWN_FORK;
+}
+
+/* function to read a size in bytes such as 1048576, 256k or 1m; returns -1 if the text is not one */
+long parseByteSize(const char *text)
+{
+    char *end;
+    long size = strtol(text, &end, 10);
+
+    if (end == text || size < 0) return -1;
+    if (*end == 'k' || *end == 'K') { size *= 1024; end++; }
+    else if (*end == 'm' || *end == 'M') { size *= 1024 * 1024; end++; }
+
+    return (*end == '\0' && size <= INT_MAX) ? size : -1;
+}
+
+/* function to change the buffer of a pipe, returns the size the kernel granted or -1 */
+long resizePipe(int fd, long size)
+{
+    if (fcntl(fd, F_SETPIPE_SZ, (int)size) < 0) return -1;
+    return fcntl(fd, F_GETPIPE_SZ);
+}
+
+/* function to set the shell's pipe buffer size; a scratch pipe is resized first to learn what the kernel grants. Returns 0 or -1 */
+int setPipeSize(long size)
+{
+    if (size == 0) // back to the kernel default
+    {
+        pipeSize = 0;
+        pipeSizeGranted = 0;
+        return 0;
+    }
+
+    int probe[2];
+    if (pipe2(probe, O_CLOEXEC) < 0)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    long granted = resizePipe(probe[0], size);
+    int err = errno;
+
+    close(probe[0]);
+    close(probe[1]);
+
+    if (granted < 0)
+    {
+        fprintf(stderr, "Error: pipe size %ld cannot be set: %s\n", size, strerror(err));
+        return -1;
+    }
+
+    pipeSize = size;
+    pipeSizeGranted = granted;
+    return 0;
+}
+
+/* function to select the pipe buffer size from the environment */
+void selectPipeSize()
+{
+    char *value = getenv("MYSH_PIPESIZE");
+
+    pipeSize = 0;
+    pipeSizeGranted = 0;
+    if (value == NULL || *value == '\0') return;
+
+    long size = parseByteSize(value);
+    if (size < 0)
+    {
+        fprintf(stderr, "Error: invalid MYSH_PIPESIZE: %s\n", value);
+        return;
+    }
+
+    setPipeSize(size);
+}
+
+/* function to select the -k memory ceiling from the environment */
+void selectOrderLimit()
+{
+    char *value = getenv("MYSH_ORDER_LIMIT");
+
+    orderMemoryLimit = 1 << 20;
+    if (value == NULL || *value == '\0') return;
+
+    long limit = parseByteSize(value);
+    if (limit < 0)
+    {
+        fprintf(stderr, "Error: invalid MYSH_ORDER_LIMIT: %s\n", value);
+        return;
+    }
+
+    orderMemoryLimit = limit;
+}
+
+/* function to select the always-on time mode from the environment */
+void selectTimeMode()
+{
+    char *value = getenv("MYSH_TIME");
+    timeAll = (value != NULL && (strcmp(value, "1") == 0 || strcmp(value, "on") == 0));
+}
+
+/* function for the set built-in: "set" prints the shell options, "set pipesize=N" changes the pipe buffer size and reports what the kernel granted,
+   "set time=on|off" turns the time report on or off for every line */
+int runSet(int argc, char **argv)
+{
+    if (argc == 1)
+    {
+        if (pipeSize == 0) printf("pipesize=default\n");
+        else printf("pipesize=%ld\n", pipeSizeGranted);
+        printf("time=%s\n", timeAll ? "on" : "off");
+        return 0;
+    }
+
+    int status = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "time=on") == 0 || strcmp(argv[i], "time=off") == 0)
+        {
+            timeAll = (argv[i][6] == 'n');
+            continue;
+        }
+
+        if (strncmp(argv[i], "pipesize=", 9) != 0)
+        {
+            fprintf(stderr, "set: unknown option: %s\n", argv[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        long size = parseByteSize(argv[i] + 9);
+        if (size < 0)
+        {
+            fprintf(stderr, "set: invalid pipe size: %s\n", argv[i] + 9);
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if (setPipeSize(size) < 0)
+        {
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if (size != 0 && pipeSizeGranted != size) printf("pipesize: requested %ld, granted %ld\n", size, pipeSizeGranted); // the kernel rounds up to a power of two pages
+    }
+
+    return status;
+}
+
+/* function to open the redirection files of a packet in the parent, so every backend reports the same errors */
+int openRedirections(commandPacket *packet, int *inFd, int *outFd)
+{
+    *inFd = -1;
+    *outFd = -1;
+
+    if (packet->inputFile) // input redirection
+    {
+        *inFd = open(packet->inputFile, O_RDONLY | O_CLOEXEC);
+        if (*inFd < 0)
+        {
+            fprintf(stderr, "no such file or directory: %s\n", packet->inputFile);
+            return -1;
+        }
+    }
+
+    if (packet->outputFile) // output redirection
+    {
+        *outFd = open(packet->outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+        if (*outFd < 0)
+        {
+            if (*inFd >= 0) close(*inFd);
+            *inFd = -1;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* function to write all of a buffer, returns -1 on error */
+int writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+/* launched child tracked by the reaper */
+typedef struct {
+    pid_t pid; // 0 for a free slot
+    int pidfd; // readable once the child exits, -1 if pidfd_open is not available
+    int done; // set once the child has been reaped
+    int status; // wait status once done
+    struct timespec started; // when the child was launched
+    struct timespec finished; // when its exit was collected
+    struct rusage usage; // resources the child used
+} childRecord;
+
+static childRecord *children = NULL;
+static int childCapacity = 0;
+static int reaperFd = -1; // epoll instance watching the pidfds
+static pid_t reaperOwner = 0; // process the reaper belongs to; a forked child starts its own
+static struct timespec launchStarted; // taken just before the latest child was launched
+
+/* function to note the time just before a child is launched; watchChild gives it to the child's record, so wall time includes the spawn */
+void markLaunch()
+{
+    clock_gettime(CLOCK_MONOTONIC, &launchStarted);
+}
+
+/* function to start a fresh reaper in this process; a forked child must not touch the parent's epoll instance or records */
+void resetReaper()
+{
+    if (reaperFd >= 0) close(reaperFd); // closing a copy leaves the parent's registrations alone
+
+    for (int i = 0; i < childCapacity; i++)
+    {
+        if (children[i].pid != 0 && children[i].pidfd >= 0) close(children[i].pidfd); // copies of the parent's pidfds
+    }
+
+    free(children);
+    children = NULL;
+    childCapacity = 0;
+
+    reaperOwner = getpid();
+    reaperFd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+/* function to start watching a launched child, returns its slot or -1 */
+int watchChild(pid_t pid)
+{
+    if (pid <= 0) return -1;
+    if (reaperOwner != getpid()) resetReaper();
+
+    int slot = 0;
+    while (slot < childCapacity && children[slot].pid != 0) slot++;
+
+    if (slot == childCapacity)
+    {
+        int newCapacity = childCapacity ? childCapacity * 2 : 16;
+        childRecord *temp = shellRealloc(children, sizeof(childRecord) * newCapacity);
+        if (!temp) return -1; // the caller falls back to waitpid()
+
+        memset(temp + childCapacity, 0, sizeof(childRecord) * (newCapacity - childCapacity));
+        children = temp;
+        childCapacity = newCapacity;
+    }
+
+    childRecord *child = &children[slot];
+    memset(child, 0, sizeof(*child));
+    child->pid = pid;
+    child->started = launchStarted;
+
+    /* the pidfd becomes readable when the child exits, in whatever order that happens */
+    child->pidfd = (reaperFd >= 0) ? syscall(SYS_pidfd_open, pid, 0) : -1;
+
+    if (child->pidfd >= 0)
+    {
+        struct epoll_event event = {.events = EPOLLIN, .data.u32 = slot};
+        if (epoll_ctl(reaperFd, EPOLL_CTL_ADD, child->pidfd, &event) < 0)
+        {
+            close(child->pidfd);
+            child->pidfd = -1;
+        }
+    }
+
+    return slot;
+}
+
+/* function to collect the exit of a child; options is 0 to block until it exits or WNOHANG. Returns 1 once it is collected */
+int collectChild(childRecord *child, int options)
+{
+    pid_t result;
+    while ((result = wait4(child->pid, &child->status, options, &child->usage)) < 0 && errno == EINTR);
+
+    if (result == 0) return 0; // still running
+
+    clock_gettime(CLOCK_MONOTONIC, &child->finished);
+    child->done = 1;
+
+    if (child->pidfd >= 0)
+    {
+        /* removed explicitly: a forked child may still hold a copy of the pidfd, which would keep it registered after close */
+        epoll_ctl(reaperFd, EPOLL_CTL_DEL, child->pidfd, NULL);
+        close(child->pidfd);
+        child->pidfd = -1;
+    }
+
+    return 1;
+}
+
+/* function to collect every watched child that has exited; timeout is in milliseconds, -1 waits for at least one. Returns the number of exits seen */
+int reapReady(int timeout)
+{
+    struct epoll_event events[16];
+    int ready;
+
+    if (reaperFd < 0) return 0;
+    while ((ready = epoll_wait(reaperFd, events, 16, timeout)) < 0 && errno == EINTR);
+
+    for (int i = 0; i < ready; i++)
+    {
+        childRecord *child = &children[events[i].data.u32];
+        if (child->pid != 0 && !child->done) collectChild(child, 0);
+    }
+
+    return (ready > 0) ? ready : 0;
+}
+
+/* function to wait until every given slot has been reaped; children are collected as they exit, not in slot order */
+void waitChildren(const int *slots, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (slots[i] < 0) continue;
+
+        childRecord *child = &children[slots[i]];
+        while (!child->done)
+        {
+            if (child->pidfd < 0) collectChild(child, 0); // no pidfd: plain blocking wait
+            else reapReady(-1);
+        }
+    }
+}
+
+/* function to wait for a launched child and release its slot, returns the wait status (EXIT_FAILURE status if it could not be waited for).
+   record (NULL if unused) receives a copy of the child's record, with its times and resource use */
+int waitChild(pid_t pid, int slot, childRecord *record)
+{
+    int status = EXIT_FAILURE << 8;
+
+    if (slot < 0)
+    {
+        if (pid > 0) waitpid(pid, &status, 0);
+        if (record) record->pid = 0; // nothing was measured
+        return status;
+    }
+
+    waitChildren(&slot, 1);
+    status = children[slot].status;
+    if (record) *record = children[slot];
+    children[slot].pid = 0;
+    return status;
+}
+
+/* function to start measuring a stage that runs inside the shell; the record holds the shell's own use so far */
+void startShellUsage(childRecord *record)
+{
+    memset(record, 0, sizeof(*record));
+    record->pid = getpid();
+    clock_gettime(CLOCK_MONOTONIC, &record->started);
+    getrusage(RUSAGE_SELF, &record->usage);
+}
+
+/* function to finish measuring an in-shell stage: the record keeps what the stage used, except max RSS, which is the shell's */
+void finishShellUsage(childRecord *record, int code)
+{
+    struct rusage now;
+    getrusage(RUSAGE_SELF, &now);
+    clock_gettime(CLOCK_MONOTONIC, &record->finished);
+
+    timersub(&now.ru_utime, &record->usage.ru_utime, &record->usage.ru_utime);
+    timersub(&now.ru_stime, &record->usage.ru_stime, &record->usage.ru_stime);
+    record->usage.ru_minflt = now.ru_minflt - record->usage.ru_minflt;
+    record->usage.ru_majflt = now.ru_majflt - record->usage.ru_majflt;
+    record->usage.ru_maxrss = now.ru_maxrss;
+    record->status = (code & 0xff) << 8; // kept as a wait status, like a child's
+    record->done = 1;
+}
+
+/* function to turn a wait status into the exit code a shell reports, 128 + the signal for a killed child */
+int exitCode(int status)
+{
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/* function to get the nanoseconds between two monotonic times */
+long elapsedNanos(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000000L + (to->tv_nsec - from->tv_nsec);
+}
+
+/* function to check whether one monotonic time comes before another */
+int timespecBefore(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/* function to add a stage's record to the total of its pipeline: times and faults add up, max RSS is the largest, wall time spans them all */
+void addUsage(childRecord *total, const childRecord *record)
+{
+    if (total->pid == 0 || timespecBefore(&record->started, &total->started)) total->started = record->started;
+    if (total->pid == 0 || timespecBefore(&total->finished, &record->finished)) total->finished = record->finished;
+    total->pid = 1; // something was added
+
+    timeradd(&total->usage.ru_utime, &record->usage.ru_utime, &total->usage.ru_utime);
+    timeradd(&total->usage.ru_stime, &record->usage.ru_stime, &total->usage.ru_stime);
+    total->usage.ru_minflt += record->usage.ru_minflt;
+    total->usage.ru_majflt += record->usage.ru_majflt;
+    if (record->usage.ru_maxrss > total->usage.ru_maxrss) total->usage.ru_maxrss = record->usage.ru_maxrss;
+}
+
+/* function to report what a command or a pipeline stage used, as one line of key=value fields on STDERR:
+   time line=L stage=S pid=P status=C wall=SEC user=SEC sys=SEC maxrss_kb=K minflt=N majflt=N cmd=WORDS
+   stage is "total" for the sum of a pipeline (pid 0), and cmd runs to the end of the line. stages is the number of packets in cmd */
+void reportUsage(const char *stage, const childRecord *record, commandPacket *packets, int stages)
+{
+    char line[BUFSIZE];
+    int status = exitCode(record->status);
+    double wall = elapsedNanos(&record->started, &record->finished) / 1e9;
+
+    int used = snprintf(line, sizeof(line), "time line=%ld stage=%s pid=%d status=%d wall=%.6f user=%ld.%06ld sys=%ld.%06ld maxrss_kb=%ld minflt=%ld majflt=%ld cmd=",
+                        lineNumber, stage, (int)record->pid, status, wall,
+                        (long)record->usage.ru_utime.tv_sec, (long)record->usage.ru_utime.tv_usec,
+                        (long)record->usage.ru_stime.tv_sec, (long)record->usage.ru_stime.tv_usec,
+                        record->usage.ru_maxrss, record->usage.ru_minflt, record->usage.ru_majflt);
+
+    /* the command words, truncated to fit; the line goes out in one write so concurrent chains do not mix their reports */
+    for (int i = 0; i < stages; i++)
+    {
+        for (char **word = packets[i].commandArgument; *word && used < (int)sizeof(line) - 2; word++)
+        {
+            const char *separator = (word != packets[i].commandArgument) ? " " : (i > 0) ? " | " : "";
+            used += snprintf(line + used, sizeof(line) - 1 - used, "%s%s", separator, *word);
+        }
+    }
+
+    if (used > (int)sizeof(line) - 2) used = sizeof(line) - 2;
+    line[used++] = '\n';
+
+    fflush(stdout); // the report comes after the output of what it measured
+    fflush(stderr);
+    writeAll(STDERR_FILENO, line, used);
+}
+
+/* buffered output for a trace; records are added whole, so a flush never splits one */
+typedef struct {
+    int fd; // -1 while this trace is off
+    pid_t owner; // process the buffered records belong to; a forked child drops what it inherited
+    size_t used;
+    char data[OUTPUT_BUFSIZE];
+} traceOutput;
+
+/* execution traces: MYSH_TRACE writes one JSON record per command or pipeline stage, MYSH_CHROME_TRACE writes Chrome trace events */
+static traceOutput jsonTrace = {.fd = -1};
+static traceOutput chromeTrace = {.fd = -1};
+static int tracing = 0; // set while either trace is on; nothing is measured for them otherwise
+static pid_t chromeRoot = 0; // shell that opened the Chrome trace, every event is filed under it
+static struct timespec traceParseStarted; // when the line being run started to be parsed
+static long traceParseNanos = 0; // time the line being run took to parse
+
+/* what the spawn layer measured for the latest launch, kept for the trace */
+typedef struct {
+    char path[BUFSIZE]; // program that was found, empty if none
+    long lookupNanos; // search path lookup
+    long spawnNanos; // posix_spawn() or fork() call
+} launchTrace;
+
+static launchTrace lastLaunch;
+
+/* function to write out the records buffered for one trace; records a forked child inherited are its parent's to write */
+void flushTraceOutput(traceOutput *trace)
+{
+    if (trace->owner != getpid()) trace->used = 0;
+    if (trace->fd >= 0 && trace->used > 0) writeAll(trace->fd, trace->data, trace->used);
+
+    trace->used = 0;
+    trace->owner = getpid();
+}
+
+/* function to write out both traces, at exit and before a forked chain ends */
+void traceFlush()
+{
+    flushTraceOutput(&jsonTrace);
+    flushTraceOutput(&chromeTrace);
+}
+
+/* function to finish the traces when the shell is done: everything is written, and the shell that started the Chrome trace closes its array */
+void closeTraces()
+{
+    traceFlush();
+    if (chromeTrace.fd < 0 || getpid() != chromeRoot) return;
+
+    char footer[128];
+    int length = snprintf(footer, sizeof(footer), "{\"name\":\"trace_end\",\"ph\":\"M\",\"pid\":%d,\"args\":{}}\n]\n", (int)chromeRoot);
+    writeAll(chromeTrace.fd, footer, length);
+
+    close(chromeTrace.fd);
+    chromeTrace.fd = -1;
+    tracing = (jsonTrace.fd >= 0);
+}
+
+/* function to add a whole record to a trace's buffer */
+void traceWrite(traceOutput *trace, const char *record, size_t length)
+{
+    if (trace->owner != getpid() || trace->used + length > sizeof(trace->data)) flushTraceOutput(trace);
+
+    if (length > sizeof(trace->data)) writeAll(trace->fd, record, length);
+    else
+    {
+        memcpy(trace->data + trace->used, record, length);
+        trace->used += length;
+    }
+}
+
+/* function to open a trace named by an environment variable: a number is an open fd, anything else a file.
+   flags are added when a file is opened; returns the fd, or -1 */
+int openTraceOutput(const char *variable, int flags)
+{
+    char *value = getenv(variable);
+    if (value == NULL || *value == '\0') return -1;
+
+    char *end;
+    long fd = strtol(value, &end, 10);
+    int traceFd;
+
+    if (*end == '\0' && fd >= 0 && fd <= INT_MAX)
+    {
+        traceFd = fcntl((int)fd, F_DUPFD_CLOEXEC, 3); // a private copy, so launched programs do not inherit it
+        if (traceFd < 0) fprintf(stderr, "Error: %s fd %ld cannot be used: %s\n", variable, fd, strerror(errno));
+    }
+    else
+    {
+        traceFd = open(value, O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0640);
+        if (traceFd < 0) fprintf(stderr, "Error: Could not open trace file %s: %s\n", value, strerror(errno));
+    }
+
+    return traceFd;
+}
+
+/* function to select the traces from the environment: MYSH_TRACE records are appended to their file,
+   a Chrome trace starts a new file, since it holds one JSON array */
+void selectTrace()
+{
+    static int registered = 0;
+
+    traceFlush();
+    if (jsonTrace.fd >= 0) close(jsonTrace.fd);
+    if (chromeTrace.fd >= 0) close(chromeTrace.fd);
+
+    jsonTrace.fd = openTraceOutput("MYSH_TRACE", O_APPEND);
+    chromeTrace.fd = openTraceOutput("MYSH_CHROME_TRACE", O_TRUNC);
+    tracing = (jsonTrace.fd >= 0 || chromeTrace.fd >= 0);
+
+    if (chromeTrace.fd >= 0)
+    {
+        /* chains add their events while they run; the array is closed when the shell finishes (a trace cut short still loads, the ] is optional) */
+        char header[256];
+        chromeRoot = getpid();
+        int length = snprintf(header, sizeof(header), "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"mysh\"}},\n"
+                              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"shell\"}},\n",
+                              (int)chromeRoot, (int)chromeRoot, (int)chromeRoot);
+        writeAll(chromeTrace.fd, header, length); // written now, ahead of any chain's events
+    }
+
+    if (tracing && !registered)
+    {
+        atexit(closeTraces);
+        registered = 1;
+    }
+}
+
+/* function to note the path search of a launch for the trace */
+void traceLookup(const struct timespec *started, const char *path)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    lastLaunch.lookupNanos = elapsedNanos(started, &now);
+    snprintf(lastLaunch.path, sizeof(lastLaunch.path), "%s", path);
+    lastLaunch.spawnNanos = 0;
+}
+
+/* function to note, for the trace, how long the spawn call took since markLaunch() */
+void markSpawned()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    lastLaunch.spawnNanos = elapsedNanos(&launchStarted, &now);
+}
+
+/* function to append a JSON string to a trace record; returns the new length, or the old one if the string does not fit */
+size_t traceString(char *record, size_t used, size_t size, const char *text)
+{
+    size_t start = used;
+    if (used + 2 > size) return start;
+
+    record[used++] = '"';
+
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    {
+        if (used + 7 > size) return start; // the longest escape and the closing quote must still fit
+
+        if (*c == '"' || *c == '\\')
+        {
+            record[used++] = '\\';
+            record[used++] = *c;
+        }
+        else if (*c < 0x20) used += snprintf(record + used, size - used, "\\u%04x", *c);
+        else record[used++] = *c;
+    }
+
+    record[used++] = '"';
+    return used;
+}
+
+/* function to append argv to a trace record as a JSON array; words that do not fit are left out rather than the record */
+size_t traceArgv(char *record, size_t used, size_t size, char **argv)
+{
+    record[used++] = '[';
+
+    for (char **word = argv; *word; word++)
+    {
+        int comma = (word != argv);
+        size_t next = traceString(record, used + comma, size - 1, *word);
+        if (next == used + comma) break;
+
+        if (comma) record[used] = ',';
+        used = next;
+    }
+
+    record[used++] = ']';
+    return used;
+}
+
+/* function to name the Chrome trace track of a process */
+void traceTrackName(pid_t tid, const char *name)
+{
+    char metadata[BUFSIZE + 128];
+    size_t length = snprintf(metadata, sizeof(metadata), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                             (int)chromeRoot, (int)tid);
+    length = traceString(metadata, length, sizeof(metadata) - 8, name);
+    length += snprintf(metadata + length, sizeof(metadata) - length, "}},\n");
+    traceWrite(&chromeTrace, metadata, length);
+}
+
+/* function to write a Chrome trace event: a complete event (ph X) from started lasting nanos, or an instant one (ph i) when nanos is -1.
+   tid is the track, a child's own pid or the shell's; args is the inside of the event's args object */
+void traceEvent(const char *name, pid_t tid, const struct timespec *started, long nanos, const char *args)
+{
+    char event[2 * BUFSIZE + 512];
+    long long ts = started->tv_sec * 1000000000LL + started->tv_nsec;
+
+    size_t used = snprintf(event, sizeof(event), "{\"name\":");
+    used = traceString(event, used, BUFSIZE, name);
+
+    if (nanos < 0) used += snprintf(event + used, sizeof(event) - used, ",\"ph\":\"i\",\"s\":\"t\"");
+    else used += snprintf(event + used, sizeof(event) - used, ",\"ph\":\"X\",\"dur\":%ld.%03ld", nanos / 1000, nanos % 1000);
+
+    used += snprintf(event + used, sizeof(event) - used, ",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d,\"args\":{%s}},\n",
+                     ts / 1000, ts % 1000, (int)chromeRoot, (int)tid, args);
+
+    if (used < sizeof(event)) traceWrite(&chromeTrace, event, used); // an event cut short would break the array
+}
+
+/* function to write the Chrome trace events of the line just parsed */
+void traceParse()
+{
+    if (chromeTrace.fd < 0) return;
+
+    char args[64];
+    snprintf(args, sizeof(args), "\"line\":%ld", lineNumber);
+    traceEvent("parse", getpid(), &traceParseStarted, traceParseNanos, args);
+}
+
+/* function to write the Chrome trace event of the shell waiting for the children of a line, from started until now */
+void traceWait(const struct timespec *started)
+{
+    if (chromeTrace.fd < 0) return;
+
+    struct timespec now;
+    char args[64];
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    snprintf(args, sizeof(args), "\"line\":%ld", lineNumber);
+    traceEvent("wait", getpid(), started, elapsedNanos(started, &now), args);
+}
+
+/* function to write the trace of one stage (1 for a simple command). launch is NULL for a stage that ran inside the shell;
+   record->pid is 0 for a stage that could not be launched. run_ns runs from the end of the spawn call to the exit being collected.
+   In the Chrome trace the spawn is on the shell's track and the run on the child's own track, named after it */
+void traceStage(int stage, commandPacket *packet, const childRecord *record, const launchTrace *launch, int builtin)
+{
+    char entry[2 * BUFSIZE + 512];
+    size_t room = sizeof(entry) - 512; // the fields after argv always fit in the rest
+    long spawnNanos = launch ? launch->spawnNanos : 0;
+    long runNanos = record->pid ? elapsedNanos(&record->started, &record->finished) - spawnNanos : 0;
+
+    if (jsonTrace.fd >= 0)
+    {
+        size_t used = snprintf(entry, sizeof(entry), "{\"line\":%ld,\"stage\":%d,\"argv\":", lineNumber, stage);
+        used = traceArgv(entry, used, room - BUFSIZE, packet->commandArgument);
+        used += snprintf(entry + used, sizeof(entry) - used, ",\"path\":");
+
+        size_t next = (launch && launch->path[0]) ? traceString(entry, used, room, launch->path) : used;
+        if (next == used) used += snprintf(entry + used, sizeof(entry) - used, "null");
+        else used = next;
+
+        used += snprintf(entry + used, sizeof(entry) - used,
+                         ",\"builtin\":%s,\"pid\":%d,\"parse_ns\":%ld,\"lookup_ns\":%ld,\"spawn_ns\":%ld,\"run_ns\":%ld,\"exit\":%d}\n",
+                         builtin ? "true" : "false", (int)record->pid, traceParseNanos, launch ? launch->lookupNanos : 0L,
+                         spawnNanos, runNanos, exitCode(record->status));
+
+        traceWrite(&jsonTrace, entry, used);
+    }
+
+    if (chromeTrace.fd < 0) return;
+
+    /* args shared by the events of the stage */
+    size_t used = snprintf(entry, sizeof(entry), "\"line\":%ld,\"stage\":%d,\"exit\":%d,\"argv\":", lineNumber, stage, exitCode(record->status));
+    used = traceArgv(entry, used, room - BUFSIZE, packet->commandArgument);
+    entry[used] = '\0';
+
+    char *name = packet->commandArgument[0];
+    struct timespec now;
+
+    if (record->pid == 0) // nothing was launched
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        traceEvent("not started", getpid(), &now, -1, entry);
+        return;
+    }
+
+    if (launch == NULL) // ran inside the shell
+    {
+        traceEvent(name, record->pid, &record->started, elapsedNanos(&record->started, &record->finished), entry);
+        return;
+    }
+
+    traceEvent("spawn", getpid(), &record->started, spawnNanos, entry);
+
+    traceTrackName(record->pid, name); // the child's track is named when its run is written
+    struct timespec running = record->started;
+    running.tv_sec += (running.tv_nsec + spawnNanos) / 1000000000L;
+    running.tv_nsec = (running.tv_nsec + spawnNanos) % 1000000000L;
+    traceEvent(name, record->pid, &running, runNanos, entry);
+}
+
+/* background job started with & */
+typedef struct {
+    int id; // number shown by jobs and taken by wait, 0 for a free entry
+    int *slots; // reaper slots of the job's processes in pipeline order, -1 for stages that did not start
+    int count; // number of stages
+    char *command; // the job's command line, as shown by jobs
+} jobEntry;
+
+static jobEntry *jobTable = NULL;
+static int jobCapacity = 0;
+static int nextJobId = 1;
+
+/* function to rebuild the text of a parsed line for jobs */
+char *describeCommand(parsedCommand *parsed)
+{
+    size_t length = 1;
+    for (int i = 0; i < parsed->stageCount; i++)
+    {
+        commandPacket *stage = &parsed->stages[i];
+        for (int j = 0; stage->commandArgument[j]; j++) length += strlen(stage->commandArgument[j]) + 1;
+        if (stage->inputFile) length += strlen(stage->inputFile) + 3;
+        if (stage->outputFile) length += strlen(stage->outputFile) + 3;
+        length += 2;
+    }
+
+    char *text = shellMalloc(length);
+    if (!text) return NULL;
+
+    char *p = text;
+    for (int i = 0; i < parsed->stageCount; i++)
+    {
+        commandPacket *stage = &parsed->stages[i];
+
+        if (i > 0) p += sprintf(p, "| ");
+        for (int j = 0; stage->commandArgument[j]; j++) p += sprintf(p, "%s ", stage->commandArgument[j]);
+        if (stage->inputFile) p += sprintf(p, "< %s ", stage->inputFile);
+        if (stage->outputFile) p += sprintf(p, "> %s ", stage->outputFile);
+    }
+
+    if (p > text) p--; // drop the last space
+    *p = '\0';
+    return text;
+}
+
+/* function to record a launched background pipeline in the job table, returns its id or -1 */
+int addJob(parsedCommand *parsed, const int *slots, int count)
+{
+    int entry = 0;
+    while (entry < jobCapacity && jobTable[entry].id != 0) entry++;
+
+    if (entry == jobCapacity)
+    {
+        int newCapacity = jobCapacity ? jobCapacity * 2 : 8;
+        jobEntry *temp = shellRealloc(jobTable, sizeof(jobEntry) * newCapacity);
+        if (!temp) return -1;
+
+        memset(temp + jobCapacity, 0, sizeof(jobEntry) * (newCapacity - jobCapacity));
+        jobTable = temp;
+        jobCapacity = newCapacity;
+    }
+
+    jobEntry *job = &jobTable[entry];
+    job->slots = shellMalloc(sizeof(int) * count);
+    job->command = describeCommand(parsed);
+
+    if (!job->slots || !job->command)
+    {
+        free(job->slots);
+        free(job->command);
+        return -1;
+    }
+
+    memcpy(job->slots, slots, sizeof(int) * count);
+    job->count = count;
+    job->id = nextJobId++;
+    return job->id;
+}
+
+/* function to check whether every process of a job has been reaped */
+int jobFinished(jobEntry *job)
+{
+    for (int i = 0; i < job->count; i++)
+    {
+        if (job->slots[i] >= 0 && !children[job->slots[i]].done) return 0;
+    }
+
+    return 1;
+}
+
+/* function to get a finished job's status, which is the status of its last stage (128 + the signal if it was killed) */
+int jobStatus(jobEntry *job)
+{
+    int last = job->slots[job->count - 1];
+    return (last >= 0) ? exitCode(children[last].status) : EXIT_FAILURE;
+}
+
+/* function to print a finished job the way jobs lists it: Done, Exit and the code, or the signal that killed it */
+void printFinishedJob(jobEntry *job)
+{
+    int last = job->slots[job->count - 1];
+
+    if (last >= 0 && WIFSIGNALED(children[last].status)) printf("[%d] %s\t%s\n", job->id, strsignal(WTERMSIG(children[last].status)), job->command);
+    else if (jobStatus(job) != 0) printf("[%d] Exit %d\t%s\n", job->id, jobStatus(job), job->command);
+    else printf("[%d] Done\t%s\n", job->id, job->command);
+}
+
+/* function to remove a job from the table and release its reaper slots */
+void releaseJob(jobEntry *job)
+{
+    for (int i = 0; i < job->count; i++)
+    {
+        if (job->slots[i] >= 0) children[job->slots[i]].pid = 0;
+    }
+
+    free(job->slots);
+    free(job->command);
+    memset(job, 0, sizeof(*job));
+}
+
+/* function to find a job by the id given to wait ("2" or "%2"), returns NULL if there is none */
+jobEntry *findJob(const char *text)
+{
+    if (*text == '%') text++;
+
+    char *end;
+    long id = strtol(text, &end, 10);
+    if (end == text || *end != '\0') return NULL;
+
+    for (int i = 0; i < jobCapacity; i++)
+    {
+        if (jobTable[i].id != 0 && jobTable[i].id == id) return &jobTable[i];
+    }
+
+    return NULL;
+}
+
+/* function to collect background jobs that have exited without blocking; the main loop calls it between lines.
+   In interactive mode finished jobs are reported and removed, in batch mode they stay until jobs or wait */
+void pollJobs()
+{
+    if (jobTable == NULL) return;
+
+    while (reapReady(0) > 0);
+
+    for (int i = 0; i < jobCapacity; i++)
+    {
+        jobEntry *job = &jobTable[i];
+        if (job->id == 0) continue;
+
+        /* children without a pidfd are not seen by epoll */
+        for (int j = 0; j < job->count; j++)
+        {
+            childRecord *child = (job->slots[j] >= 0) ? &children[job->slots[j]] : NULL;
+            if (child && !child->done && child->pidfd < 0) collectChild(child, WNOHANG);
+        }
+
+        if (interactive && jobFinished(job))
+        {
+            printFinishedJob(job);
+            releaseJob(job);
+        }
+    }
+}
+
+/* function for the jobs built-in: lists the background jobs, finished ones are removed once listed */
+int runJobs(int argc)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "jobs: Too many arguments.\n");
+        return EXIT_FAILURE;
+    }
+
+    pollJobs();
+
+    for (int i = 0; i < jobCapacity; i++)
+    {
+        jobEntry *job = &jobTable[i];
+        if (job->id == 0) continue;
+
+        if (!jobFinished(job))
+        {
+            printf("[%d] Running\t%s\n", job->id, job->command);
+            continue;
+        }
+
+        printFinishedJob(job);
+        releaseJob(job);
+    }
+
+    return 0;
+}
+
+/* function for the wait built-in: "wait" waits for every job and succeeds, "wait id..." returns the status of the last job given */
+int runWait(int argc, char **argv)
+{
+    int status = 0;
+
+    if (argc == 1)
+    {
+        for (int i = 0; i < jobCapacity; i++)
+        {
+            if (jobTable[i].id == 0) continue;
+
+            waitChildren(jobTable[i].slots, jobTable[i].count);
+            releaseJob(&jobTable[i]);
+        }
+
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        jobEntry *job = findJob(argv[i]);
+        if (job == NULL)
+        {
+            fprintf(stderr, "wait: no such job: %s\n", argv[i]);
+            status = 127;
+            continue;
+        }
+
+        waitChildren(job->slots, job->count);
+        status = jobStatus(job);
+        releaseJob(job);
+    }
+
+    return status;
+}
+
+/* function to launch an external command; pipeFds (-1 if unused) are placed on STDIN/STDOUT before the packet's own redirection.
+   Every other fd the shell opens is close-on-exec, so the child keeps nothing else. Returns the child's pid, or -1 if nothing was started */
+pid_t spawnCommand(commandPacket *packet, int pipeIn, int pipeOut)
+{
+    int inFd, outFd;
+    if (openRedirections(packet, &inFd, &outFd) < 0) return -1;
+
+    char path[BUFSIZE];
+    struct timespec lookupStarted;
+    if (tracing) clock_gettime(CLOCK_MONOTONIC, &lookupStarted);
+
+    int found = findExecutable(packet->commandArgument[0], path, sizeof(path));
+    if (tracing) traceLookup(&lookupStarted, (found < 0) ? "" : path);
+
+    if (found < 0)
+    {
+        if (inFd >= 0) close(inFd);
+        if (outFd >= 0) close(outFd);
+        return -1; // command cannot be executed, we have FAILED
+    }
+
+    /* when mysh reads a non-terminal stdin, the child gets /dev/null unless it is given an input */
+    int devNull = (pipeIn < 0 && inFd < 0 && (launchingJob || (!builtinStdin && !interactive && !isatty(STDIN_FILENO))));
+
+    fflush(stdout); // anything the shell printed must come out before the child's output
+    fflush(stderr);
+
+    pid_t pid = -1;
+    markLaunch(); // wall time counts the spawn itself
+
+    if (spawnBackend == SPAWN_POSIX)
+    {
+        /* posix_spawn shares the parent's memory until exec (CLONE_VM | CLONE_VFORK in glibc), so no page tables are copied */
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+
+        if (pipeIn >= 0) posix_spawn_file_actions_adddup2(&actions, pipeIn, STDIN_FILENO);
+        if (pipeOut >= 0) posix_spawn_file_actions_adddup2(&actions, pipeOut, STDOUT_FILENO);
+        if (devNull) posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        if (inFd >= 0) posix_spawn_file_actions_adddup2(&actions, inFd, STDIN_FILENO);
+        if (outFd >= 0) posix_spawn_file_actions_adddup2(&actions, outFd, STDOUT_FILENO);
+
+        int err = posix_spawn(&pid, path, &actions, NULL, packet->commandArgument, environ);
+        posix_spawn_file_actions_destroy(&actions);
+
+        if (err != 0) pid = -1;
+    }
+    else
+    {
+        pid = fork();
+
+        if (pid == 0) // child process
+        {
+            if (pipeIn >= 0) dup2(pipeIn, STDIN_FILENO);
+            if (pipeOut >= 0) dup2(pipeOut, STDOUT_FILENO);
+            if (devNull) applyDevNullIfBatchNoInput();
+            if (inFd >= 0) dup2(inFd, STDIN_FILENO);
+            if (outFd >= 0) dup2(outFd, STDOUT_FILENO);
+
+            execv(path, packet->commandArgument);
+            _exit(EXIT_FAILURE);
+        }
+
+        if (pid < 0) perror("fork");
+    }
+
+    if (tracing) markSpawned();
+    if (inFd >= 0) close(inFd);
+    if (outFd >= 0) close(outFd);
+
+    return pid;
+}
+
+/* STDIN/STDOUT as they were before a built-in's redirection was applied in the shell */
+typedef struct {
+    int savedIn; // copy of the original STDIN, -1 if it was not redirected
+    int savedOut; // copy of the original STDOUT, -1 if it was not redirected
+} savedStreams;
+
+/* function to apply a packet's redirection to the shell itself, saving the original fds so they can be restored */
+int redirectInShell(commandPacket *packet, savedStreams *saved)
+{
+    saved->savedIn = -1;
+    saved->savedOut = -1;
+
+    int inFd, outFd;
+    if (openRedirections(packet, &inFd, &outFd) < 0) return -1;
+
+    if (inFd >= 0)
+    {
+        saved->savedIn = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0); // keep the shell's input out of launched children
+        dup2(inFd, STDIN_FILENO);
+        close(inFd);
+        builtinStdin = 1;
+    }
+
+    if (outFd >= 0)
+    {
+        fflush(stdout); // output so far belongs to the original STDOUT
+        saved->savedOut = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        dup2(outFd, STDOUT_FILENO);
+        close(outFd);
+    }
+
+    return 0;
+}
+
+/* function to undo redirectInShell() */
+void restoreStreams(savedStreams *saved)
+{
+    if (saved->savedOut >= 0)
+    {
+        fflush(stdout); // the built-in's output belongs to the redirected file
+        dup2(saved->savedOut, STDOUT_FILENO);
+        close(saved->savedOut);
+        saved->savedOut = -1;
+    }
+
+    if (saved->savedIn >= 0)
+    {
+        dup2(saved->savedIn, STDIN_FILENO);
+        close(saved->savedIn);
+        saved->savedIn = -1;
+        builtinStdin = 0;
+    }
+}
+
+/* function to run a program in a child and wait for it, for built-ins that hand unusual cases to the real program; returns its status */
+int runProgram(char **argv)
+{
+    commandPacket packet = {argv, NULL, NULL};
+
+    pid_t pid = spawnCommand(&packet, -1, -1);
+    if (pid < 0) return EXIT_FAILURE;
+
+    return exitCode(waitChild(pid, watchChild(pid), NULL));
+}
+
+/* function to check whether a copy error only means the fast path does not support these fds, so the next one should be tried */
+int copyUnsupported(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EBADF;
+}
+
+/* function to record whether a failed kernel copy was a write error (the fast paths do not say which side failed), returns -1 */
+int copyFailed(int *writeFailed)
+{
+    *writeFailed = (errno == EPIPE || errno == ENOSPC || errno == EDQUOT || errno == EFBIG);
+    return -1;
+}
+
+/* function to copy everything from inFd to outFd without passing the data through the shell where the kernel allows it:
+   copy_file_range between regular files, sendfile from a regular file, splice between two pipes, read/write otherwise.
+   Returns 0, or -1 with errno set; *writeFailed tells a write error from a read error */
+int copyFd(int inFd, int outFd, int *writeFailed)
+{
+    struct stat inStat, outStat;
+    if (fstat(inFd, &inStat) < 0 || fstat(outFd, &outStat) < 0) return -1;
+
+    int inFile = S_ISREG(inStat.st_mode), outFile = S_ISREG(outStat.st_mode);
+    int bothPipes = S_ISFIFO(inStat.st_mode) && S_ISFIFO(outStat.st_mode);
+    ssize_t n;
+
+    *writeFailed = 0;
+
+    if (inFile && outFile) // file to file: the copy can stay inside the filesystem
+    {
+        while ((n = copy_file_range(inFd, NULL, outFd, NULL, 1 << 30, 0)) > 0);
+        if (n == 0) return 0;
+        if (!copyUnsupported(errno)) return copyFailed(writeFailed);
+    }
+
+    if (inFile) // file to pipe, socket or terminal: pages go straight from the page cache
+    {
+        while ((n = sendfile(outFd, inFd, NULL, 1 << 30)) > 0);
+        if (n == 0) return 0;
+        if (!copyUnsupported(errno)) return copyFailed(writeFailed);
+    }
+
+    /* pipe buffers are moved, not copied. Not used from a pipe into a file: splice() takes the file offset before it waits for data,
+       so it would write over anything another process (a 2>&1 on the same file) wrote in the meantime */
+    if (bothPipes)
+    {
+        while ((n = splice(inFd, NULL, outFd, NULL, 1 << 20, SPLICE_F_MOVE)) > 0);
+        if (n == 0) return 0;
+        if (!copyUnsupported(errno)) return copyFailed(writeFailed);
+    }
+
+    /* none of the above apply (a terminal on input, for instance); the fd offsets are shared, so this carries on where they stopped */
+    char buffer[OUTPUT_BUFSIZE];
+
+    while ((n = read(inFd, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t done = 0; done < n; )
+        {
+            ssize_t written = write(outFd, buffer + done, n - done);
+            if (written < 0)
+            {
+                *writeFailed = 1;
+                return -1;
+            }
+
+            done += written;
+        }
+    }
+
+    return (n < 0) ? -1 : 0;
+}
+
+/* function for the cat built-in: copies each file (or "-" / no file for STDIN) to STDOUT. Options are left to the real cat */
+int runCat(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') return runProgram(argv);
+    }
+
+    fflush(stdout); // output written by the shell so far comes first
+
+    /* in batch mode STDIN holds the script, so without redirection cat reads nothing, like a launched program given /dev/null */
+    int stdinUsable = builtinStdin || interactive || isatty(STDIN_FILENO);
+
+    int status = 0;
+    int count = (argc > 1) ? argc - 1 : 1;
+
+    for (int i = 0; i < count; i++)
+    {
+        char *name = (argc > 1) ? argv[i + 1] : "-";
+        int fd = STDIN_FILENO;
+
+        if (strcmp(name, "-") == 0)
+        {
+            if (!stdinUsable) continue;
+        }
+        else
+        {
+            fd = open(name, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+                status = EXIT_FAILURE;
+                continue;
+            }
+        }
+
+        int writeFailed;
+        int result = copyFd(fd, STDOUT_FILENO, &writeFailed);
+        int err = errno;
+
+        if (fd != STDIN_FILENO) close(fd);
+
+        if (result < 0 && writeFailed && err == EPIPE) return EXIT_FAILURE; // the reader is gone, stop quietly
+
+        if (result < 0)
+        {
+            if (writeFailed) fprintf(stderr, "cat: write error: %s\n", strerror(err));
+            else fprintf(stderr, "cat: %s: %s\n", name, strerror(err));
+            status = EXIT_FAILURE;
+        }
+    }
+
+    return status;
+}
+
+/* item of the parallel built-in that is running */
+typedef struct {
+    int slot; // reaper slot of its process
+    pid_t pid;
+    char *item; // the item, for failure reports
+    long number; // position of the item in the input, from 1
+} parallelTask;
+
+/* function to get the next item for parallel: the next argument after ":::", or the next line of input. Returns a heap string or NULL when there are no more */
+char *nextParallelItem(char **items, int *nextItem, FILE *input)
+{
+    if (items) return items[*nextItem] ? shellStrdup(items[(*nextItem)++]) : NULL;
+
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+
+    while ((length = getline(&line, &capacity, input)) >= 0)
+    {
+        if (length > 0 && line[length - 1] == '\n') line[--length] = '\0';
+        if (length > 0) return line; // empty lines are not items
+    }
+
+    free(line);
+    return NULL;
+}
+
+/* function to build the argv of one parallel item: every {} in the template is replaced by the item, or the item is added at the end if there is no {} */
+char **buildParallelArgs(char **template, int templateCount, const char *item)
+{
+    size_t itemLength = strlen(item);
+    int placed = 0;
+
+    char **args = shellMalloc(sizeof(char *) * (templateCount + 2));
+    if (!args) return NULL;
+
+    for (int i = 0; i < templateCount; i++)
+    {
+        size_t count = 0;
+        for (char *p = strstr(template[i], "{}"); p; p = strstr(p + 2, "{}")) count++;
+
+        args[i] = shellMalloc(strlen(template[i]) + count * itemLength + 1);
+        if (!args[i])
+        {
+            while (i-- > 0) free(args[i]);
+            free(args);
+            return NULL;
+        }
+
+        char *out = args[i];
+        for (const char *p = template[i]; *p; )
+        {
+            if (p[0] == '{' && p[1] == '}')
+            {
+                memcpy(out, item, itemLength);
+                out += itemLength;
+                p += 2;
+                placed = 1;
+            }
+            else *out++ = *p++;
+        }
+        *out = '\0';
+    }
+
+    args[templateCount] = placed ? NULL : shellStrdup(item);
+    args[templateCount + 1] = NULL;
+    return args;
+}
+
+/* function to free an argv from buildParallelArgs() */
+void freeParallelArgs(char **args)
+{
+    for (int i = 0; args[i]; i++) free(args[i]);
+    free(args);
+}
+
+/* function to wait for one running parallel item (or xargs batch) and report it if it failed; the task is removed from tasks. Returns its exit code */
+int finishParallelTask(parallelTask *tasks, int *running)
+{
+    int index = -1;
+
+    while (index < 0)
+    {
+        for (int i = 0; i < *running && index < 0; i++)
+        {
+            childRecord *child = &children[tasks[i].slot];
+            if (child->done || (child->pidfd < 0 && collectChild(child, WNOHANG))) index = i;
+        }
+
+        if (index >= 0) break;
+
+        if (children[tasks[0].slot].pidfd < 0) collectChild(&children[tasks[0].slot], 0); // no pidfds: block on the oldest
+        else reapReady(-1);
+    }
+
+    parallelTask *task = &tasks[index];
+    int status = children[task->slot].status;
+    int code = exitCode(status);
+
+    if (code != 0 && task->item) fprintf(stderr, "parallel: item %ld (%s) failed with status %d\n", task->number, task->item, code);
+
+    children[task->slot].pid = 0; // release the slot
+    free(task->item);
+    tasks[index] = tasks[--(*running)];
+
+    return code;
+}
+
+/* function for the parallel built-in: parallel [-j N] command [args with {}] [::: items...].
+   Each item (an argument after ":::", otherwise a line of input) is put into the template and run through the spawn layer, at most N at a time.
+   The status is the number of failed items (capped at 101), and each failure is reported */
+int runParallel(int argc, char **argv)
+{
+    long slots = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+
+    if (first < argc && strncmp(argv[first], "-j", 2) == 0)
+    {
+        char *value = (argv[first][2] != '\0') ? argv[first] + 2 : (first + 1 < argc ? argv[first + 1] : "");
+        char *end;
+        slots = strtol(value, &end, 10);
+
+        if (end == value || *end != '\0' || slots < 1 || slots > 4096)
+        {
+            fprintf(stderr, "parallel: -j needs a number of slots between 1 and 4096.\n");
+            return EXIT_FAILURE;
+        }
+
+        first += (argv[first][2] != '\0') ? 1 : 2;
+    }
+
+    if (slots < 1) slots = 1;
+
+    /* the template runs up to ":::", the items follow it */
+    int templateCount = 0;
+    while (first + templateCount < argc && strcmp(argv[first + templateCount], ":::") != 0) templateCount++;
+
+    char **template = &argv[first];
+    char **items = (first + templateCount < argc) ? &argv[first + templateCount + 1] : NULL;
+
+    if (templateCount == 0)
+    {
+        fprintf(stderr, "parallel: usage: parallel [-j N] command [argument]... [::: item...]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (isBuiltinCommand(template[0]) && !isUtilityBuiltin(template[0]))
+    {
+        fprintf(stderr, "parallel: %s is a shell built-in and cannot be run in parallel.\n", template[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* items come from STDIN when it is real input; in batch mode without redirection there are none, like for cat */
+    FILE *input = NULL;
+    if (!items)
+    {
+        if (!builtinStdin && !interactive && !isatty(STDIN_FILENO)) return 0;
+
+        int fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+        input = (fd >= 0) ? fdopen(fd, "r") : NULL;
+        if (!input)
+        {
+            if (fd >= 0) close(fd);
+            perror("parallel");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* the work queue holds at most one task per slot; items are read only when a slot is free */
+    parallelTask *tasks = shellMalloc(sizeof(parallelTask) * slots);
+    if (!tasks)
+    {
+        if (input) fclose(input);
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    int running = 0, nextItem = 0;
+    long failures = 0, number = 0;
+    char *item;
+
+    while ((item = nextParallelItem(items, &nextItem, input)) != NULL)
+    {
+        number++;
+        if (running == slots) failures += (finishParallelTask(tasks, &running) != 0);
+
+        char **args = buildParallelArgs(template, templateCount, item);
+        pid_t pid = -1;
+
+        if (args)
+        {
+            commandPacket packet = {args, NULL, NULL};
+
+            launchingJob = 1; // the items do not read the shell's input
+            pid = spawnCommand(&packet, -1, -1);
+            launchingJob = 0;
+
+            freeParallelArgs(args);
+        }
+
+        int slot = watchChild(pid);
+        if (slot < 0)
+        {
+            int code = EXIT_FAILURE;
+            if (pid > 0) // cannot be watched, wait for it here
+            {
+                int status;
+                waitpid(pid, &status, 0);
+                code = exitCode(status);
+            }
+
+            if (code != 0)
+            {
+                if (pid > 0) fprintf(stderr, "parallel: item %ld (%s) failed with status %d\n", number, item, code);
+                else fprintf(stderr, "parallel: item %ld (%s) could not be started\n", number, item);
+                failures++;
+            }
+
+            free(item);
+            continue;
+        }
+
+        tasks[running++] = (parallelTask){slot, pid, item, number};
+    }
+
+    while (running > 0) failures += (finishParallelTask(tasks, &running) != 0);
+
+    free(tasks);
+    if (input) fclose(input);
+
+    if (failures > 0) fprintf(stderr, "parallel: %ld of %ld items failed\n", failures, number);
+    return (failures > 101) ? 101 : (int)failures;
+}
+
+/* function to read the next xargs item: a NUL terminated one with -0, otherwise a run of non-blank characters. Returns its length, or -1 at end of input */
+ssize_t nextXargsItem(FILE *input, int nulSeparated, char **item, size_t *capacity)
+{
+    if (nulSeparated)
+    {
+        ssize_t length = getdelim(item, capacity, '\0', input);
+        if (length > 0 && (*item)[length - 1] == '\0') length--;
+        return length;
+    }
+
+    int c;
+    while ((c = getc(input)) != EOF && isspace(c));
+    if (c == EOF) return -1;
+
+    size_t length = 0;
+    do
+    {
+        if (length + 1 >= *capacity)
+        {
+            size_t newCapacity = *capacity ? *capacity * 2 : 256;
+            char *temp = shellRealloc(*item, newCapacity);
+            if (!temp) return -1;
+            *item = temp;
+            *capacity = newCapacity;
+        }
+
+        (*item)[length++] = c;
+    } while ((c = getc(input)) != EOF && !isspace(c));
+
+    (*item)[length] = '\0';
+    return length;
+}
+
+/* function to start one xargs batch (the template followed by the packed items) once a slot is free.
+   Returns 127 if it cannot be started, otherwise the exit code of a batch that had to finish first (0 if none failed) */
+int launchXargsBatch(char **args, parallelTask *tasks, int *running, long slots, long number)
+{
+    commandPacket packet = {args, NULL, NULL};
+    int earlier = 0;
+
+    if (*running == slots) earlier = finishParallelTask(tasks, running);
+
+    launchingJob = 1; // the command does not read the items' input
+    pid_t pid = spawnCommand(&packet, -1, -1);
+    launchingJob = 0;
+
+    if (pid < 0)
+    {
+        fprintf(stderr, "xargs: %s: cannot run command\n", args[0]);
+        return 127;
+    }
+
+    int slot = watchChild(pid);
+    if (slot < 0) // cannot be watched, wait for it here
+    {
+        int status;
+        waitpid(pid, &status, 0);
+        return exitCode(status) ? exitCode(status) : earlier;
+    }
+
+    tasks[(*running)++] = (parallelTask){slot, pid, NULL, number};
+    return earlier;
+}
+
+/* function for the xargs built-in: xargs [-P N] [-n max] [-0] [-r] [command [argument]...].
+   Items from STDIN are packed into as few command lines as fit in ARG_MAX (less the environment), so the fewest processes are started */
+int runXargs(int argc, char **argv)
+{
+    long slots = 1, maxItems = 0;
+    int nulSeparated = 0, skipEmpty = 0;
+    int first = 1;
+
+    while (first < argc && argv[first][0] == '-' && argv[first][1] != '\0')
+    {
+        char option = argv[first][1];
+
+        if (option == '0' || option == 'r')
+        {
+            if (option == '0') nulSeparated = 1;
+            else skipEmpty = 1;
+            first++;
+            continue;
+        }
+
+        if (option != 'P' && option != 'n') break; // the command itself
+
+        char *value = (argv[first][2] != '\0') ? argv[first] + 2 : (first + 1 < argc ? argv[first + 1] : "");
+        char *end;
+        long number = strtol(value, &end, 10);
+
+        if (end == value || *end != '\0' || number < 1 || (option == 'P' && number > 4096))
+        {
+            fprintf(stderr, "xargs: invalid number for -%c: %s\n", option, value);
+            return EXIT_FAILURE;
+        }
+
+        if (option == 'P') slots = number;
+        else maxItems = number;
+
+        first += (argv[first][2] != '\0') ? 1 : 2;
+    }
+
+    static char *defaultTemplate[] = {"echo", NULL};
+    char **template = (first < argc) ? &argv[first] : defaultTemplate;
+    int templateCount = (first < argc) ? argc - first : 1;
+
+    if (isBuiltinCommand(template[0]) && !isUtilityBuiltin(template[0]))
+    {
+        fprintf(stderr, "xargs: %s is a shell built-in and cannot be run by xargs.\n", template[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* the room a command line may take: ARG_MAX, less what the environment takes and the 2048 bytes POSIX asks to leave */
+    long budget = sysconf(_SC_ARG_MAX);
+    if (budget <= 0) budget = 131072;
+    budget -= 2048;
+
+    for (char **env = environ; *env; env++) budget -= strlen(*env) + 1 + sizeof(char *);
+    for (int i = 0; i < templateCount; i++) budget -= strlen(template[i]) + 1 + sizeof(char *);
+    budget -= sizeof(char *); // the terminating NULL
+
+    long itemLimit = 32 * sysconf(_SC_PAGESIZE); // MAX_ARG_STRLEN: the kernel refuses any single argument longer than this
+
+    if (budget <= 0)
+    {
+        fprintf(stderr, "xargs: environment is too large for a command line\n");
+        return EXIT_FAILURE;
+    }
+
+    /* items come from STDIN when it is real input; in batch mode without redirection there are none, like for cat */
+    FILE *input = NULL;
+    if (builtinStdin || interactive || isatty(STDIN_FILENO))
+    {
+        int fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+        input = (fd >= 0) ? fdopen(fd, "r") : NULL;
+        if (!input)
+        {
+            if (fd >= 0) close(fd);
+            perror("xargs");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* one batch at a time: its strings are packed into one buffer of the budget's size, which is reused once the batch is launched */
+    char *strings = shellMalloc(budget);
+    int argsCapacity = templateCount + 1024;
+    char **args = shellMalloc(sizeof(char *) * argsCapacity);
+    parallelTask *tasks = shellMalloc(sizeof(parallelTask) * slots);
+
+    if (!strings || !args || !tasks)
+    {
+        free(strings);
+        free(args);
+        free(tasks);
+        if (input) fclose(input);
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    memcpy(args, template, sizeof(char *) * templateCount);
+
+    char *item = NULL;
+    size_t itemCapacity = 0;
+    ssize_t length;
+
+    long used = 0, batchItems = 0, batches = 0;
+    int running = 0, status = 0, launched = 0;
+
+    while (status != 127 && input && (length = nextXargsItem(input, nulSeparated, &item, &itemCapacity)) >= 0)
+    {
+        long cost = length + 1 + sizeof(char *);
+
+        if (cost > budget || length + 1 > itemLimit)
+        {
+            fprintf(stderr, "xargs: argument line too long\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        /* the batch is full: start it and begin the next one */
+        if (batchItems > 0 && (used + cost > budget || batchItems == maxItems))
+        {
+            args[templateCount + batchItems] = NULL;
+            int code = launchXargsBatch(args, tasks, &running, slots, ++batches);
+            if (code != 0) status = (code == 127) ? 127 : 123;
+
+            launched = 1;
+            used = 0;
+            batchItems = 0;
+        }
+
+        if (templateCount + batchItems + 1 >= argsCapacity)
+        {
+            char **temp = shellRealloc(args, sizeof(char *) * argsCapacity * 2);
+            if (!temp)
+            {
+                fprintf(stderr, "Error: Memory reallocation failed.\n");
+                status = EXIT_FAILURE;
+                break;
+            }
+
+            args = temp;
+            argsCapacity *= 2;
+        }
+
+        char *copy = strings + (used - batchItems * (long)sizeof(char *)); // pointers are counted in the budget but live in args
+        memcpy(copy, item, length + 1);
+        args[templateCount + batchItems++] = copy;
+        used += cost;
+    }
+
+    /* the last batch; without items the command still runs once, unless -r. Nothing more runs once reading the items failed */
+    if ((status == 0 || status == 123) && (batchItems > 0 || (!launched && !skipEmpty)))
+    {
+        args[templateCount + batchItems] = NULL;
+        int code = launchXargsBatch(args, tasks, &running, slots, ++batches);
+        if (code != 0) status = (code == 127) ? 127 : 123;
+    }
+
+    while (running > 0)
+    {
+        if (finishParallelTask(tasks, &running) != 0 && status == 0) status = 123;
+    }
+
+    free(item);
+    free(strings);
+    free(args);
+    free(tasks);
+    if (input) fclose(input);
+
+    return status;
+}
+
+/* function to run a built-in command in the current process, returns its status */
+int runBuiltin(int argc, char **argv)
+{
+    char *command = argv[0];
+
+    if (strcmp(command, "cd") == 0) return runCD(argc, argv); // cd command
+
+    if (strcmp(command, "pwd") == 0) return runPWD(argc); // pwd command
+
+    if (strcmp(command, "which") == 0) // which command
+    {
+        if (argc != 2) return EXIT_FAILURE; // must be 2 arguments
+
+        return runWhich(argv[1]);
+    }
+
+    if (strcmp(command, "hash") == 0) return runHash(argc, argv); // hash command
+
+    if (strcmp(command, "memstats") == 0) return runMemstats(argc); // memstats command
+
+    if (strcmp(command, "set") == 0) return runSet(argc, argv); // set command
+
+    if (strcmp(command, "jobs") == 0) return runJobs(argc); // jobs command
+
+    if (strcmp(command, "wait") == 0) return runWait(argc, argv); // wait command
+
+    if (strcmp(command, "echo") == 0) return runEcho(argc, argv); // echo command
+
+    if (strcmp(command, "printf") == 0) return runPrintf(argc, argv); // printf command
+
+    if (strcmp(command, "cat") == 0) return runCat(argc, argv); // cat command
+
+    if (strcmp(command, "parallel") == 0) return runParallel(argc, argv); // parallel command
+
+    if (strcmp(command, "xargs") == 0) return runXargs(argc, argv); // xargs command
+
+    if (strcmp(command, "true") == 0) return 0; // true command
+
+    if (strcmp(command, "false") == 0) return EXIT_FAILURE; // false command
+
+    if (strcmp(command, "exit") == 0) runExit(); // exits safely
+
+    if (strcmp(command, "die") == 0) runDie(argc, argv); // abortion
+
+    return EXIT_FAILURE; // not a built-in
+}
+
+/* function to execute 1 built-in command inside a CHILD PROCESS (pipeline stages) */
+void runSingleCommandInChild(commandPacket *packet)
+{
+    /* retreive command to execute */
+    char *command = packet->commandArgument[0];
+
+    int argc = 0; // num of arguments
+    while(packet->commandArgument[argc]) argc++;
+
+    /* apply redirection */
+    int inFd, outFd;
+    if (openRedirections(packet, &inFd, &outFd) < 0) exit(EXIT_FAILURE);
+
+    if (inFd >= 0) // input redirection 
+    {
+        dup2(inFd, STDIN_FILENO);
+        close(inFd);
+    }
+
+    if (outFd >= 0) // output redirection 
+    {
+        dup2(outFd, STDOUT_FILENO);
+        close(outFd);
+    }
+
+    if (strcmp(command, "exit") == 0) exit(EXIT_SUCCESS); // exits safely, the shell itself says goodbye
+
+    builtinStdin = 1; // STDIN is already the stage's input (pipe, redirection or /dev/null)
+
+    /* built-in commands within child */
+    exit(runBuiltin(argc, packet->commandArgument));
+}
+
+/* function to check whether a built-in pipeline stage can run inside the shell: it must not read its input or change the shell's state.
+   cat, parallel and xargs only read the pipe after the first stage, so they run in the shell only as the first stage */
+int runsInShellInPipeline(const char *command, int first)
+{
+    if (strcmp(command, "cat") == 0 || strcmp(command, "parallel") == 0 || strcmp(command, "xargs") == 0) return first;
+
+    return isBuiltinCommand(command) && strcmp(command, "cd") != 0 && strcmp(command, "exit") != 0 && strcmp(command, "die") != 0 && strcmp(command, "set") != 0 && strcmp(command, "wait") != 0;
+}
+
+/* function to run a built-in pipeline stage inside the shell with STDOUT on pipeOut (-1 for the last stage), returns its status */
+int runBuiltinStage(commandPacket *packet, int pipeOut)
+{
+    int argc = 0;
+    while (packet->commandArgument[argc]) argc++;
+
+    /* a reader that already exited must give the built-in EPIPE instead of killing the shell */
+    struct sigaction ignore, previous;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &previous);
+
+    savedStreams piped = {-1, -1};
+    if (pipeOut >= 0)
+    {
+        fflush(stdout);
+        piped.savedOut = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        dup2(pipeOut, STDOUT_FILENO);
+    }
+
+    int status = EXIT_FAILURE;
+    savedStreams saved;
+
+    if (redirectInShell(packet, &saved) == 0)
+    {
+        status = runBuiltin(argc, packet->commandArgument);
+        restoreStreams(&saved);
+    }
+
+    restoreStreams(&piped);
+    clearerr(stdout); // a write error belongs to this stage only
+
+    sigaction(SIGPIPE, &previous, NULL);
+    return status;
+}
+
+/* function that executes a full pipeline */
+int runPipeline(parsedCommand *parsed)
+{
+    int n = parsed->stageCount;
+    commandPacket *packets = parsed->stages;
+
+    /* per-pipeline arrays live in the arena, sized by the stage count */
+    pid_t *pids = arenaAlloc(sizeof(pid_t) * n); // store PIDs of each pipeline process, 0 for stages that run inside the shell
+    int *writeEnds = arenaAlloc(sizeof(int) * n); // write ends kept open for the stages that run inside the shell
+    int *codes = arenaAlloc(sizeof(int) * n); // statuses of the stages that run inside the shell
+    int *slots = arenaAlloc(sizeof(int) * n); // reaper slots of the launched stages, -1 for the others
+    int measured = (parsed->timed || tracing) && !parsed->background;
+    childRecord *records = measured ? arenaAlloc(sizeof(childRecord) * n) : NULL; // what each stage used, for time and the traces
+    launchTrace *launches = (measured && tracing) ? arenaAlloc(sizeof(launchTrace) * n) : NULL; // lookup and spawn times, for the traces
+
+    if (!pids || !writeEnds || !codes || !slots || (measured && !records) || (measured && tracing && !launches))
+    {
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* launch once for each segment in the pipeline; each pipe is created just before the stage that writes to it,
+       close-on-exec, so a child only ever holds the two ends it is given */
+    int pipeIn = -1; // read end of the previous stage's pipe
+    int resizeOk = 1;
+
+    for (int i = 0; i < n; i++)
+    {
+        char *command = packets[i].commandArgument[0];
+        int pipeFds[2] = {-1, -1};
+
+        if (i < n - 1 && pipe2(pipeFds, O_CLOEXEC) < 0) // if not last command: pipe STDOUT -> next pipe
+        {
+            perror("pipe");
+            for (int j = i; j < n; j++)
+            {
+                pids[j] = -1; // the rest of the pipeline is not started
+                slots[j] = -1;
+            }
+            break;
+        }
+
+        /* a resize that fails leaves the default buffer; it is reported once per pipeline */
+        if (pipeFds[0] >= 0 && parsed->pipeSize > 0 && resizeOk && resizePipe(pipeFds[0], parsed->pipeSize) < 0)
+        {
+            fprintf(stderr, "Error: pipe size %ld cannot be set: %s\n", parsed->pipeSize, strerror(errno));
+            resizeOk = 0;
+        }
+
+        int pipeOut = pipeFds[1];
+        writeEnds[i] = -1;
+
+        if (!isBuiltinCommand(command)) // external commands go through the spawn layer
+        {
+            pids[i] = spawnCommand(&packets[i], pipeIn, pipeOut);
+            if (launches) launches[i] = lastLaunch;
+        }
+        else if (!parsed->background && runsInShellInPipeline(command, i == 0)) // built-ins that only write output run in the shell once every process is launched
+        {
+            pids[i] = 0;
+            writeEnds[i] = pipeOut;
+            pipeOut = -1; // kept open until the stage runs
+        }
+        else
+        {
+            fflush(stdout);
+            markLaunch();
+            pids[i] = fork();
+
+            if (pids[i] == 0)
+            {
+                if (pipeIn >= 0)
+                {
+                    dup2(pipeIn, STDIN_FILENO);
+                    close(pipeIn);
+                } else if (launchingJob || !isatty(STDIN_FILENO)) 
+                {
+                    applyDevNullIfBatchNoInput(); // first command in batch mode or of a job; redirect STDIN to /dev/null
+                }
+
+                if (pipeOut >= 0)
+                {
+                    dup2(pipeOut, STDOUT_FILENO);
+                    close(pipeOut);
+                }
+
+                if (pipeFds[0] >= 0) close(pipeFds[0]);
+
+                /* this child does not exec, so write ends held for in-shell stages must be closed by hand or their readers never see end of input */
+                for (int j = 0; j < i; j++)
+                {
+                    if (pids[j] == 0 && writeEnds[j] >= 0) close(writeEnds[j]);
+                }
+
+                runSingleCommandInChild(&packets[i]);
+            }
+
+            if (launches)
+            {
+                markSpawned();
+                launches[i].path[0] = '\0'; // a built-in has no program to look up
+                launches[i].lookupNanos = 0;
+                launches[i].spawnNanos = lastLaunch.spawnNanos;
+            }
+        }
+
+        slots[i] = (pids[i] > 0) ? watchChild(pids[i]) : -1;
+
+        /* the parent only keeps the read end for the next stage */
+        if (pipeIn >= 0) close(pipeIn);
+        if (pipeOut >= 0) close(pipeOut);
+        pipeIn = pipeFds[0];
+    }
+
+    if (pipeIn >= 0) close(pipeIn); // left over when launching stopped early
+
+    /* a background job is recorded and left running; every stage of it is a process */
+    if (parsed->background)
+    {
+        int id = addJob(parsed, slots, n);
+        if (id < 0)
+        {
+            fprintf(stderr, "Error: Memory allocation failed.\n");
+            waitChildren(slots, n);
+            for (int i = 0; i < n; i++) if (slots[i] >= 0) children[slots[i]].pid = 0;
+            return EXIT_FAILURE;
+        }
+
+        if (interactive) printf("[%d] %d\n", id, (int)pids[n - 1]);
+        return 0;
+    }
+
+    /* run the in-shell stages in order; their readers are already running or have had their read end closed, so no write can block forever */
+    for (int i = 0; i < n; i++)
+    {
+        if (pids[i] != 0) continue;
+
+        if (records) startShellUsage(&records[i]);
+        codes[i] = runBuiltinStage(&packets[i], writeEnds[i]);
+        if (records) finishShellUsage(&records[i], codes[i]);
+        if (writeEnds[i] >= 0) close(writeEnds[i]); // the next stage sees end of input
+    }
+
+    /* collect the stages as they exit, whatever their order in the pipeline */
+    struct timespec waitStarted;
+    if (tracing) clock_gettime(CLOCK_MONOTONIC, &waitStarted);
+
+    waitChildren(slots, n);
+    if (tracing) traceWait(&waitStarted);
+
+    /* pipeline result = last command's status */
+    int status = 0;
+
+    for (int i = 0; i < n; i++) {
+        int code = EXIT_FAILURE; // stages that could not be launched count as failures
+
+        if (pids[i] == 0) code = codes[i];
+        else if (pids[i] > 0) code = exitCode(waitChild(pids[i], slots[i], records ? &records[i] : NULL));
+        else if (records)
+        {
+            memset(&records[i], 0, sizeof(childRecord)); // not launched, nothing to report
+            records[i].status = code << 8;
+        }
+
+        /* If any child ran die(), terminate entire shell */
+        if (dieFlag) {
+            runDie(1, NULL);
+            status = 1;
+            shellStatus = 1;
+        }
+
+        if (i == n - 1){
+            status = code;
+            if (strcmp(packets[n-1].commandArgument[0], "die") == 0 && code != 0) {
+                dieExecuted = 1;  // Set flag in parent process
+                shellStatus = EXIT_FAILURE;
+                exit(EXIT_FAILURE);  // Exit immediately without goodbye
+            }
+        }
+    }
+
+    /* trace: one record per stage, in pipeline order */
+    for (int i = 0; launches && i < n; i++)
+    {
+        int inShell = (pids[i] == 0);
+        traceStage(i + 1, &packets[i], &records[i], inShell ? NULL : &launches[i], isBuiltinCommand(packets[i].commandArgument[0]));
+    }
+
+    /* time: one line per stage in pipeline order, then their total */
+    if (records && parsed->timed)
+    {
+        childRecord total;
+        memset(&total, 0, sizeof(total));
+
+        for (int i = 0; i < n; i++)
+        {
+            if (records[i].pid == 0) continue;
+
+            char stage[16];
+            snprintf(stage, sizeof(stage), "%d", i + 1);
+            reportUsage(stage, &records[i], &packets[i], 1);
+            addUsage(&total, &records[i]);
+        }
+
+        total.pid = 0;
+        total.status = (status & 0xff) << 8;
+        reportUsage("total", &total, packets, n);
+    }
+
+    return status; // last process determines pipeline status
+}
+
+/* function that processes command line and acts accordingly to the arguments given; function acts as dispatcher between pipelines and regular commands */
+int runCommand(char *commandLine)
+{
+    /* ignore NULL input */
+    if(!commandLine) return 0;
+
+    commandEpoch++; // lets cached lookups revalidate once for this line
+    arenaReset(); // everything parsed for the previous line is released at once
+
+    /* parse the line in place: conditional prefix, pipeline stages, argv and redirection */
+    parsedCommand parsed;
+    if (tracing) clock_gettime(CLOCK_MONOTONIC, &traceParseStarted);
+
+    int parseResult = parseCommandLine(commandLine, &parsed);
+
+    if (tracing)
+    {
+        struct timespec parseFinished;
+        clock_gettime(CLOCK_MONOTONIC, &parseFinished);
+        traceParseNanos = elapsedNanos(&traceParseStarted, &parseFinished);
+        traceParse();
+    }
+
+    if (parseResult < 0)
+    {
+        lastStatus = 1;
+        return EXIT_FAILURE;
+    }
+
+    if (parsed.conditional == COND_NONE && parsed.stageCount == 0) return 0; // empty line or comment
+
+    int isAnd = (parsed.conditional == COND_AND), isOr = (parsed.conditional == COND_OR);
+
+    if ((isAnd || isOr) && lastStatus == -1) // fail check if conditional operator given before a completed command
+    {
+        fprintf(stderr, "Error: Conditional cannot be first command.\n");
+
+        lastStatus = 1;
+        return EXIT_FAILURE;
+    }
+
+    /* conditional operators run only if previous succeeded */
+    if (isAnd && lastStatus != 0) return lastStatus;   // skip execution
+    if (isOr && lastStatus == 0) return lastStatus;   // skip execution
+
+    if (parsed.stageCount == 0) return EXIT_SUCCESS; // nothing left to execute
+
+    /* leading words that apply to this line only: pipesize=N sets the pipe buffer size, time reports what each stage used */
+    parsed.pipeSize = pipeSize;
+    parsed.timed = timeAll;
+    char **firstArgs = parsed.stages[0].commandArgument;
+
+    while (firstArgs[1] != NULL)
+    {
+        if (strcmp(firstArgs[0], "time") == 0) parsed.timed = 1;
+        else if (strncmp(firstArgs[0], "pipesize=", 9) == 0)
+        {
+            parsed.pipeSize = parseByteSize(firstArgs[0] + 9);
+            if (parsed.pipeSize < 0)
+            {
+                fprintf(stderr, "Error: invalid pipe size: %s\n", firstArgs[0] + 9);
+                lastStatus = 1;
+                return EXIT_FAILURE;
+            }
+        }
+        else break;
+
+        firstArgs++;
+    }
+
+    parsed.stages[0].commandArgument = firstArgs;
+
+    /* BACKGROUND JOB (any number of stages, every stage is a process); it is not timed, the line only starts it */
+    if (parsed.background)
+    {
+        parsed.timed = 0;
+        launchingJob = 1;
+        lastStatus = runPipeline(&parsed); // 0 once the job is started
+        launchingJob = 0;
+
+        return lastStatus;
+    }
+
+    /* PIPELINE execution */
+    if (parsed.stageCount > 1)
+    {
+        int status = runPipeline(&parsed); // run pipeline
+
+        /* If pipeline contained exit, shell must terminate */
+        for (int i = 0; i < parsed.stageCount; i++)
+        {
+            if (strcmp(parsed.stages[i].commandArgument[0], "exit") == 0) runExit();
+        }
+
+        /* record pipeline exit status for future and/or */
+        lastStatus = status;
+        return status;
+    }
+
+    /* SIMPLE COMMANDS */
+    commandPacket packet = parsed.stages[0];
+    char *command = packet.commandArgument[0];
+
+    int argc = 0;
+    while(packet.commandArgument[argc] != NULL) argc++;
+
+    /* BUILT-INS (run directly in the shell, any redirection is applied around them and undone afterwards) */
+    if(isBuiltinCommand(command))
+    {
+        int status = EXIT_FAILURE;
+        savedStreams saved;
+        childRecord record;
+        int measured = parsed.timed || tracing;
+
+        if (measured) startShellUsage(&record);
+
+        if (redirectInShell(&packet, &saved) == 0)
+        {
+            status = runBuiltin(argc, packet.commandArgument);
+            restoreStreams(&saved);
+        }
+
+        if (measured) finishShellUsage(&record, status);
+        if (tracing) traceStage(1, &packet, &record, NULL, 1);
+        if (parsed.timed) reportUsage("1", &record, &packet, 1);
+
+        lastStatus = status;
+        return status;
+    }
+
+    /* EXTERNAL COMMAND (spawn layer) */
+    pid_t pid = spawnCommand(&packet, -1, -1);
+
+    /* parent process waits for external command */
+    int code = EXIT_FAILURE;
+    childRecord record;
+    memset(&record, 0, sizeof(record));
+    record.status = EXIT_FAILURE << 8; // what is traced if nothing was launched
+
+    if (pid > 0)
+    {
+        struct timespec waitStarted;
+        if (tracing) clock_gettime(CLOCK_MONOTONIC, &waitStarted);
+
+        code = exitCode(waitChild(pid, watchChild(pid), &record));
+        if (tracing) traceWait(&waitStarted);
+        if (parsed.timed && record.pid != 0) reportUsage("1", &record, &packet, 1);
+    }
+
+    if (tracing) traceStage(1, &packet, &record, &lastLaunch, 0);
+
+    /* If child executed die(), terminate entire shell */
+    if (dieFlag) {
+        runDie(1, NULL);
+    }
+
+    /* store exit status for future AND/OR conditions */
+    lastStatus = code;
+    return lastStatus;
+}
+
+int initializeShell(int argc, char *argv[])
+{
+    /* -j N (or -jN) and -k come before the batch file */
+    parallelSlots = 1;
+    keepOrder = 0;
+    lineNumber = 0;
+
+    while (argc > 1)
+    {
+        if (strcmp(argv[1], "-k") == 0)
+        {
+            keepOrder = 1;
+            argc--;
+            argv++;
+            continue;
+        }
+
+        if (strncmp(argv[1], "-j", 2) != 0) break;
+
+        char *value = (argv[1][2] != '\0') ? argv[1] + 2 : (argc > 2 ? argv[2] : "");
+        char *end;
+        long slots = strtol(value, &end, 10);
+
+        if (end == value || *end != '\0' || slots < 1 || slots > 4096)
+        {
+            fprintf(stderr, "Error: -j needs a number of slots between 1 and 4096.\n");
+            return EXIT_FAILURE;
+        }
+
+        parallelSlots = (int)slots;
+
+        int used = (argv[1][2] != '\0') ? 1 : 2;
+        argc -= used;
+        argv += used;
+    }
+
+    selectOrderLimit();
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "Error: There should be at most 2 arguments.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 2)
+    {
+        char *batchFile = argv[1];
+        int status = runBatchFile(batchFile);
+        if (status != 0) return EXIT_FAILURE;
+    }
+
+    interactive = isatty(STDIN_FILENO);
+    selectSpawnBackend();
+    selectPipeSize();
+    selectTimeMode();
+    selectTrace();
+
+    if (interactive)
+    {
+        printWelcome();
+        fflush(stdout);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* function to run every line of a batch file by mapping it into memory; lines are split with memchr and handed to runCommand where they lie.
+   Returns -1 if the file cannot be mapped, so the caller can fall back to reading it */
+int runMappedBatch(int fd, size_t size)
+{
+    off_t offset = lseek(fd, 0, SEEK_CUR); // part of the file may already have been read
+    if (offset < 0 || (size_t)offset >= size) return (offset < 0) ? -1 : 0;
+
+    /* a private writable mapping lets the lexer NUL terminate words in place without touching the file */
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+
+    posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+    lseek(fd, size, SEEK_SET); // the whole file counts as read, like the streaming path
+
+    char *p = map + offset;
+    char *end = map + size;
+
+    while (p < end)
+    {
+        char *newline = memchr(p, '\n', end - p);
+
+        pollJobs(); // collect background jobs that finished while the previous line ran
+        lineNumber++;
+
+        /* the last line has no newline to overwrite; the zero-filled rest of the final page can hold its NUL, unless the file ends on a page boundary and it has to be copied */
+        if (newline == NULL && size % sysconf(_SC_PAGESIZE) != 0)
+        {
+            *end = '\0';
+            runCommand(p);
+            break;
+        }
+
+        if (newline == NULL)
+        {
+            size_t length = end - p;
+            char *last = shellMalloc(length + 1);
+            if (last)
+            {
+                memcpy(last, p, length);
+                last[length] = '\0';
+                runCommand(last);
+                free(last);
+            }
+            break;
+        }
+
+        *newline = '\0';
+        if (newline > p) runCommand(p);
+        p = newline + 1;
+    }
+
+    munmap(map, size);
+    return 0;
+}
+
+/* function to check whether a line continues the chain above it, i.e. starts with and/or */
+int continuesChain(const char *line)
+{
+    while (isspace((unsigned char)*line)) line++;
+
+    if (strncmp(line, "and", 3) == 0) line += 3;
+    else if (strncmp(line, "or", 2) == 0) line += 2;
+    else return 0;
+
+    return *line == '\0' || isspace((unsigned char)*line);
+}
+
+/* function to check whether a chain has to run in the shell itself, after every running chain has finished:
+   it changes the shell (cd, set, exit, die), looks at its jobs (jobs, wait) or starts one (&) */
+int chainRunsInShell(char **lines, int count)
+{
+    static const char *stateful[] = {"cd", "set", "exit", "die", "jobs", "wait"};
+    int inShell = 0;
+
+    for (int i = 0; i < count && !inShell; i++)
+    {
+        arenaReset(); // the line is parsed from a copy, it is parsed again when it runs
+        size_t length = strlen(lines[i]);
+        char *copy = arenaAlloc(length + 1);
+        if (!copy) return 1;
+        memcpy(copy, lines[i], length + 1);
+
+        parsedCommand parsed;
+        quietSyntaxErrors = 1;
+        int result = parseCommandLine(copy, &parsed);
+        quietSyntaxErrors = 0;
+        if (result < 0) continue; // it only prints its error
 
-    char *token = strtok(line, " \t\n"); // parse the line for the first token 
+        if (parsed.background) inShell = 1;
 
-    /* loop while there is still a token available */
-    while(token)
-    {
-        /* resize if we are at capacity */
-        if (*count >= capacity - 1)
+        for (int j = 0; j < parsed.stageCount && !inShell; j++)
         {
-            capacity *= 2;
-            tokens = realloc(tokens, sizeof(char*) * capacity);
-        }
-
-        /* store individual token in tokens array, increment count */
-        tokens[*count] = token;
-        (*count)++;
+            char **args = parsed.stages[j].commandArgument;
+            while (args[1] && (strcmp(args[0], "time") == 0 || strncmp(args[0], "pipesize=", 9) == 0)) args++; // prefix words
+            char *command = args[0];
 
-        token = strtok(NULL, " \t\n"); // search for next token 
+            for (size_t k = 0; k < sizeof(stateful) / sizeof(stateful[0]); k++)
+            {
+                if (strcmp(command, stateful[k]) == 0) inShell = 1;
+            }
+        }
     }
 
-    tokens[*count] = NULL; // terminate the token array
-    return tokens; // return the tokens from parsed command line
+    return inShell;
 }
 
-/* function to create packet (data structure that holds the information from the commandline) */
-commandPacket buildPacket(char **tokens, int count)
+/* output a chain writes in keep-order mode; the shell holds it until every earlier chain has been written out */
+typedef struct heldOutput {
+    int fd; // read end of the chain's pipe, -1 once the chain has closed it
+    int target; // STDOUT_FILENO or STDERR_FILENO
+    char *data; // output held in memory
+    size_t used;
+    size_t capacity;
+    int spillFd; // unlinked temporary file the output goes to once it passes orderMemoryLimit, -1 before
+    struct orderedChain *chain; // chain the output belongs to
+} heldOutput;
+
+/* chain started in keep-order mode */
+typedef struct orderedChain {
+    pid_t pid;
+    int slot; // reaper slot, -1 if the chain could not be watched
+    int exited; // set once its process has been reaped
+    heldOutput streams[2]; // its STDOUT and STDERR
+} orderedChain;
+
+static orderedChain **orderQueue = NULL; // chains whose output has not all been written yet, in script order; the first one is written straight through
+static int orderHead = 0;
+static int orderCount = 0;
+static int orderCapacity = 0;
+static int orderEpoll = -1; // watches the chains' pipes and the reaper
+
+/* function to open a temporary file for spilled output; it has no name, so it goes away when it is closed */
+int openSpillFile()
 {
-    /* features of the packet */
-    commandPacket packet; // node
-    packet.inputFile = NULL; // input file
-    packet.outputFile = NULL; // output file
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL || *dir == '\0') dir = "/tmp";
 
-    packet.commandArgument = malloc(sizeof(char*) * (count + 1)); // string for commandline
-    int argc = 0; // argument count
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) return fd;
 
-    /* iterate throughout the stored tokens to deteect redirection tokens */
-    for (int i = 0; i < count; i++)
+    /* filesystems without O_TMPFILE: create a file and unlink it straight away */
+    char path[BUFSIZE];
+    snprintf(path, sizeof(path), "%s/myshXXXXXX", dir);
+
+    fd = mkstemp(path);
+    if (fd >= 0)
     {
-        if (strcmp(tokens[i], "<") == 0) // input 
-        {
-            if (i + 1 < count) packet.inputFile = strdup(tokens[++i]); // copies next token as input file 
-        }
-        else if (strcmp(tokens[i], ">") == 0) // output 
-        {
-            if (i + 1 < count) packet.outputFile = strdup(tokens[++i]); // copies next token as output file
-        }
-        else
-        {
-            packet.commandArgument[argc++] = strdup(tokens[i]); // adds token to array of commands
-        }
+        unlink(path);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
     }
 
-    packet.commandArgument[argc] = NULL; // terminating array
-    return packet; // returns the packetacket
+    return fd;
 }
 
-/* function to free packet of allocated memory */
-void freePacket(commandPacket *packet)
+/* function to keep output of a chain that cannot be written yet; past the memory ceiling it goes to a temporary file */
+void holdOutput(heldOutput *held, const char *data, size_t length)
 {
-    if (!packet) return; // base case
-
-    /* if a packet has memory allocated to the commandArgument feature, free its contents */
-    if (packet->commandArgument)
+    if (held->spillFd < 0 && held->used + length > (size_t)orderMemoryLimit)
     {
-        /* iterate through all its stored strings */
-        for (int i = 0; packet->commandArgument[i] != NULL; i++) free(packet->commandArgument[i]);
+        held->spillFd = openSpillFile();
 
-        /* free commandArgument memory */
-        free(packet->commandArgument);
-        packet->commandArgument = NULL;
+        if (held->spillFd >= 0) // what is in memory goes first
+        {
+            writeAll(held->spillFd, held->data, held->used);
+            free(held->data);
+            held->data = NULL;
+            held->used = held->capacity = 0;
+        }
+        else perror("Error: cannot create a temporary file for output");
     }
 
-    /* free allocated memory for inputFile string */
-    if (packet->inputFile)
+    if (held->spillFd >= 0)
     {
-        free(packet->inputFile);
-        packet->inputFile = NULL;
+        if (writeAll(held->spillFd, data, length) < 0) perror("Error: cannot write held output");
+        return;
     }
 
-    /* free allocated memory for outputFile string */
-    if (packet->outputFile)
+    if (held->used + length > held->capacity)
     {
-        free(packet->outputFile);
-        packet->outputFile = NULL;
+        size_t newCapacity = held->capacity ? held->capacity : BUFSIZE;
+        while (held->used + length > newCapacity) newCapacity *= 2;
+
+        char *temp = shellRealloc(held->data, newCapacity);
+        if (!temp)
+        {
+            fprintf(stderr, "Error: Memory reallocation failed.\n");
+            return;
+        }
+
+        held->data = temp;
+        held->capacity = newCapacity;
     }
+
+    memcpy(held->data + held->used, data, length);
+    held->used += length;
 }
 
-/* function to execute 1 command inside a CHILD PROCESS */
-void runSingleCommandInChild(char *cmd, int inPipeline)
+/* function to write out everything a chain's stream has held so far */
+void releaseOutput(heldOutput *held)
 {
-    /* copy of cmd to tokenize without modifying original string */
-    char temp[BUFSIZE];
-    strcpy(temp, cmd);
-
-    /* tokenization */
-    int tokenCount = 0;
-    char **tokens = tokenize(temp, &tokenCount);
+    if (held->used > 0) writeAll(held->target, held->data, held->used);
 
-    /* create packet from tokens */
-    commandPacket packet = buildPacket(tokens, tokenCount); 
+    free(held->data);
+    held->data = NULL;
+    held->used = held->capacity = 0;
 
-    free(tokens); // finished process, must free 
- 
-    if (!inPipeline && !isatty(STDIN_FILENO) && packet.inputFile == NULL) applyDevNullIfBatchNoInput(); // child processes will redirect standard input to /dev/null 
+    if (held->spillFd >= 0)
+    {
+        int writeFailed;
+        lseek(held->spillFd, 0, SEEK_SET);
+        copyFd(held->spillFd, held->target, &writeFailed);
+        close(held->spillFd);
+        held->spillFd = -1;
+    }
+}
 
-    /* retreive command to execute */
-    char *command = packet.commandArgument[0];
+/* function to read what a chain wrote to one of its pipes; output of the chain at the head of the queue is written straight through, the rest is held */
+void drainOutput(heldOutput *held)
+{
+    char buffer[OUTPUT_BUFSIZE];
+    ssize_t n = read(held->fd, buffer, sizeof(buffer));
 
-    int argc = 0; // num of arguments
-    while(packet.commandArgument[argc]) argc++;
+    if (n < 0 && errno == EINTR) return;
 
-    /* apply redirection */
-    if (packet.inputFile) // input redirection 
+    if (n <= 0) // the chain is done with this stream
     {
-        int fd = open(packet.inputFile, O_RDONLY);
-        if (fd < 0){
-            fprintf(stderr, "no such file or directory: %s\n", packet.inputFile);
-            exit(EXIT_FAILURE);
-        } 
-
-        dup2(fd, STDIN_FILENO);
-        close(fd);
+        epoll_ctl(orderEpoll, EPOLL_CTL_DEL, held->fd, NULL);
+        close(held->fd);
+        held->fd = -1;
+        return;
     }
 
-    if (packet.outputFile) // output redirection 
-    {
-        int fd = open(packet.outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0640);
-        if (fd < 0){
-            exit(EXIT_FAILURE);
-        } 
-
-        dup2(fd, STDOUT_FILENO);
-        close(fd);
-    }
+    if (held->chain == orderQueue[orderHead]) writeAll(held->target, buffer, n);
+    else holdOutput(held, buffer, n);
+}
 
-    /* built-in commands within child */
-    if (strcmp(command, "cd") == 0) exit(runCD(argc, packet.commandArgument)); // cd command
+/* function to start a keep-order chain: a pipe for its STDOUT and one for its STDERR, read by the shell. writeEnds gets the ends for the chain's process */
+orderedChain *startOrderedChain(int writeEnds[2])
+{
+    orderedChain *chain = shellMalloc(sizeof(orderedChain));
+    if (!chain) return NULL;
 
-    if (strcmp(command, "pwd") == 0) exit(runPWD(argc)); // pwd command
+    memset(chain, 0, sizeof(*chain));
+    chain->slot = -1;
 
-    if (strcmp(command, "which") == 0) // which command
+    for (int i = 0; i < 2; i++)
     {
-        if (argc != 2) exit(EXIT_FAILURE); // must be 2 arguments 
+        heldOutput *held = &chain->streams[i];
+        int fds[2];
 
-        exit(runWhich(packet.commandArgument[1]));
-    }
+        held->fd = -1;
+        held->spillFd = -1;
+        held->target = (i == 0) ? STDOUT_FILENO : STDERR_FILENO;
+        held->chain = chain;
 
-    if (strcmp(command, "exit") == 0) exit(EXIT_SUCCESS); // exits safely
+        if (pipe2(fds, O_CLOEXEC) < 0)
+        {
+            perror("pipe");
+            if (i == 1)
+            {
+                epoll_ctl(orderEpoll, EPOLL_CTL_DEL, chain->streams[0].fd, NULL);
+                close(chain->streams[0].fd);
+                close(writeEnds[0]);
+            }
+            free(chain);
+            return NULL;
+        }
 
-    if (strcmp(command, "die") == 0) runDie(argc, packet.commandArgument); // abortion
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = held};
+        epoll_ctl(orderEpoll, EPOLL_CTL_ADD, fds[0], &event);
 
-    /* external commands within child */
-    char *directories[] = {"/usr/local/bin", "/usr/bin", "/bin", NULL}; // the only directories we will be searching
+        held->fd = fds[0];
+        writeEnds[i] = fds[1];
+    }
 
-    if (access(command, X_OK) == 0) execv(command, packet.commandArgument); // try to execute command, as is
+    return chain;
+}
 
-    char path[BUFSIZE]; // string to newly built path
-    for (int i = 0; directories[i]; i++)
+/* function to add a launched chain to the end of the queue */
+int queueOrderedChain(orderedChain *chain)
+{
+    if (orderCount == orderCapacity)
     {
-        snprintf(path, sizeof(path), "%s/%s", directories[i], command); // concat each possible directory to command
+        int newCapacity = orderCapacity ? orderCapacity * 2 : 16;
+        orderedChain **temp = shellRealloc(orderQueue, sizeof(orderedChain *) * newCapacity);
+        if (!temp) return -1;
 
-        if (access(path, X_OK) == 0) execv(path, packet.commandArgument); // if the command is valid, execute
+        orderQueue = temp;
+        orderCapacity = newCapacity;
     }
 
-    /* at this point, the command cannot be executed, we have FAILED */
-    exit(EXIT_FAILURE);
+    orderQueue[orderCount++] = chain;
+    return 0;
 }
 
-/* function to split pipeline into segments */
-int splitPipeline(char *line, char *segments[])
+/* function to check whether the process of a keep-order chain has exited */
+int chainExited(orderedChain *chain)
 {
-    /* features */
-    int count = 0; // number of segments
-    char *saveptr; // internal state for strtok_r()
-    char *token = strtok_r(line, "|", &saveptr); // splits line to create first token before the pipeline
+    if (chain->exited) return 1;
 
-    /* loop until we have processed all tokens or have reached the maximum amount of pipes */
-    while(token && count < MAX_PIPES)
+    if (chain->slot >= 0)
     {
-        segments[count++] = trimWhitespace(token);
-        token = strtok_r(NULL, "|", &saveptr);
+        childRecord *child = &children[chain->slot];
+        if (!child->done && child->pidfd < 0) collectChild(child, WNOHANG); // not seen by epoll
+        chain->exited = child->done;
     }
+    else if (waitpid(chain->pid, NULL, WNOHANG) != 0) chain->exited = 1;
 
-    return count; // return number of pipeline segments found 
+    return chain->exited;
 }
 
-/* function that executes a full pipeline */
-int runPipeline(char *line)
+/* function to retire the chains at the head of the queue that are finished; the next chain then becomes the head and what it has held is written first */
+void advanceOrdered()
 {
-    char *segments[MAX_PIPES];
-    char temp[BUFSIZE];
-    strcpy(temp, line);
+    while (orderHead < orderCount)
+    {
+        orderedChain *head = orderQueue[orderHead];
+        if (!chainExited(head) || head->streams[0].fd >= 0 || head->streams[1].fd >= 0) return;
 
-    /* split pipeline into segments */
-    int n = splitPipeline(temp, segments);
-    if (n < 2) return 0;
+        if (head->slot >= 0) children[head->slot].pid = 0; // release the reaper slot
+        free(head);
+        orderHead++;
 
-    /* Create n-1 pipes */
-    int pipes[MAX_PIPES][2];
-    for (int i = 0; i < n - 1; i++)
-    {
-        if (pipe(pipes[i]) < 0)
+        if (orderHead < orderCount)
         {
-            perror("pipe");
-            return EXIT_FAILURE;
+            releaseOutput(&orderQueue[orderHead]->streams[0]);
+            releaseOutput(&orderQueue[orderHead]->streams[1]);
         }
     }
 
-    /* fork once for each segment in the pipeline */
-    pid_t pids[MAX_PIPES]; // store PIDs of each pipeline process
-
-    for (int i = 0; i < n; i++)
-    {
-        pids[i] = fork();
-
-        if (pids[i] == 0)
-        {
-            /* if not first command: pipe previous -> STDIN */
-            if (i > 0)
-            {
-                dup2(pipes[i-1][0], STDIN_FILENO);
-            } else if (!isatty(STDIN_FILENO)) 
-            {
-                applyDevNullIfBatchNoInput(); // first command in batch mode; redirect STDIN to /dev/null
-            }
-
-            /* if not last command: pipe STDOUT -> next pipe */
-            if (i < n - 1) dup2(pipes[i][1], STDOUT_FILENO);
-
-            /* close all pipe fds in child */
-            for (int j = 0; j < n - 1; j++)
-            {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
+    orderHead = orderCount = 0; // the queue is empty
+}
 
-            runSingleCommandInChild(segments[i], 1);
-        }
-    }
+/* function to wait for output or an exit from the keep-order chains and handle it */
+void waitOrderedEvent()
+{
+    struct epoll_event events[16];
+    int timeout = -1;
 
-    /* parent process closes all pipe ends */
-    for (int i = 0; i < n - 1; i++)
+    /* chains the reaper cannot report are polled */
+    for (int i = orderHead; i < orderCount; i++)
     {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
+        orderedChain *chain = orderQueue[i];
+        if (!chain->exited && (chain->slot < 0 || children[chain->slot].pidfd < 0)) timeout = 50;
     }
 
-    /* pipeline result = last command's status */
-    int status = 0;
-
-    for (int i = 0; i < n; i++) {
-        int s;
-        waitpid(pids[i], &s, 0);
-        int code = WEXITSTATUS(s);
-
-        /* If any child ran die(), terminate entire shell */
-        if (dieFlag) {
-            runDie(1, NULL);
-            status = 1;
-            shellStatus = 1;
-        }
+    int ready = epoll_wait(orderEpoll, events, 16, timeout);
 
-        if (i == n - 1){
-            status = code;
-            char *lastSegment = segments[n-1];
-            if (strstr(lastSegment, "die") && code != 0) {
-                dieExecuted = 1;  // Set flag in parent process
-                shellStatus = EXIT_FAILURE;
-                exit(EXIT_FAILURE);  // Exit immediately without goodbye
-            }
-        }
+    for (int i = 0; i < ready; i++)
+    {
+        if (events[i].data.ptr == NULL) reapReady(0); // a child exited
+        else drainOutput(events[i].data.ptr);
     }
 
-    return status; // last process determines pipeline status
+    advanceOrdered();
 }
 
-/* function that processes command line and acts accordingly to the arguments given; function acts as dispatcher between pipelines and regular commands */
-int runCommand(char *commandLine)
+/* function to wait until at least one of the running chains finishes, removes the finished ones and returns how many are still running */
+int reapChains(int *running, int count)
 {
-    /* ignore NULL input */
-    if(!commandLine) return 0;
+    while (1)
+    {
+        int left = 0;
+        for (int i = 0; i < count; i++)
+        {
+            childRecord *chain = &children[running[i]];
 
-    /* strip comments from command line and leading/trailing whitespace */
-    stripComments(commandLine);
-    char *line = trimWhitespace(commandLine);
-    if(*line == '\0') return 0;
+            if (!chain->done) running[left++] = running[i];
+            else if (!keepOrder) chain->pid = 0; // release the slot; keep-order chains release theirs when their output is written
+        }
 
-    /* checks for conditional operators */
-    int isAnd = 0, isOr = 0;
+        if (left < count) return left;
 
-    /* safe tokenization process of command line */
-    char copy[BUFSIZE];
-    strcpy(copy, line); // copy
+        if (keepOrder) waitOrderedEvent(); // output has to be read for the chains to finish
+        else if (children[running[0]].pidfd < 0) collectChild(&children[running[0]], 0);
+        else reapReady(-1);
+    }
+}
 
-    char *firstTok = strtok(copy, " \t"); // first token (needed to flag conditional operators)
+/* function to wait until every chain has finished and, in keep-order mode, all of their output has been written */
+void finishChains(int *running, int *runningCount)
+{
+    while (*runningCount > 0) *runningCount = reapChains(running, *runningCount);
+    while (keepOrder && orderHead < orderCount) waitOrderedEvent();
+}
 
-    /* set flag for conditional operator */
-    if (firstTok && strcmp(firstTok, "and") == 0) isAnd = 1;
-    if (firstTok && strcmp(firstTok, "or")  == 0) isOr  = 1;
+/* function to run batch lines grouped into chains (a line plus the and/or lines after it); independent chains run at the same time,
+   each in its own process, on up to parallelSlots processes. A chain keeps its own and/or status. numbers holds each line's place in the input */
+void runChains(char **lines, long *numbers, int count)
+{
+    int *running = shellMalloc(sizeof(int) * parallelSlots); // reaper slots of the chains running now
+    int runningCount = 0;
 
-    if ((isAnd || isOr) && lastStatus == -1) // fail check if conditional operator given before a completed command
+    if (!running)
     {
-        fprintf(stderr, "Error: Conditional cannot be first command.\n");
-
-        lastStatus = 1;
-        return EXIT_FAILURE;
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return;
     }
 
-    /* conditional operators run only if previous succeeded */
-    if (isAnd && lastStatus != 0) return lastStatus;   // skip execution
-    if (isOr && lastStatus == 0) return lastStatus;   // skip execution
+    /* in keep-order mode one epoll instance watches the chains' pipes and the reaper */
+    if (keepOrder)
+    {
+        if (reaperOwner != getpid()) resetReaper();
 
-    /* CONDITIONAL OPERATOR command execution */
-    char *cmdStart = line; // original copy of command line
+        orderEpoll = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
 
-    if (isAnd || isOr) // operator found 
-    {
-        /* parse the line right after operator */
-        cmdStart += strlen(firstTok); 
-        while (*cmdStart == ' ' || *cmdStart == '\t') cmdStart++;
-        cmdStart = trimWhitespace(cmdStart);
+        if (orderEpoll < 0 || reaperFd < 0 || epoll_ctl(orderEpoll, EPOLL_CTL_ADD, reaperFd, &event) < 0)
+        {
+            perror("Error: keep-order output is not available");
+            if (orderEpoll >= 0) close(orderEpoll);
+            orderEpoll = -1;
+            keepOrder = 0;
+        }
     }
 
-    if (*cmdStart == '\0') return EXIT_SUCCESS; // nothing left to execute
+    int i = 0;
+    while (i < count)
+    {
+        int start = i++;
+        while (i < count && continuesChain(lines[i])) i++;
 
+        pid_t pid = -1;
+        orderedChain *chain = NULL;
 
-    /* PIPELINE detection and execution */
-    if(strchr(cmdStart, '|') != NULL) // pipeline detected
-    {
-        /* ensure conditionals do NOT appear inside a pipeline */
-        if (strstr(cmdStart, " and ") != NULL || strstr(cmdStart, " or ")  != NULL)
+        if (!chainRunsInShell(lines + start, i - start))
         {
-            fprintf(stderr, "Error: conditional operators cannot appear inside a pipeline.\n");
-
-            lastStatus = 1;
-            return EXIT_FAILURE;
-        }
-        
-        int status = runPipeline(cmdStart); // run pipeline
+            if (runningCount == parallelSlots) runningCount = reapChains(running, runningCount);
 
-        /* If pipeline contained exit/die, shell must terminate */
-        if (strstr(cmdStart, "exit") != NULL) runExit();
+            int writeEnds[2] = {-1, -1};
+            if (keepOrder) chain = startOrderedChain(writeEnds);
 
-        /* record pipeline exit status for future and/or */
-        lastStatus = status;
-        return status;
-    }
+            fflush(stdout); // nothing the shell printed may be printed again by the chain
+            fflush(stderr);
+            markLaunch();
+            pid = fork();
 
-    /* SIMPLE COMMANDS -> tokenize and build commandPacket for redirection parsing */
-    char temp[BUFSIZE];
-    strcpy(temp, cmdStart);
+            if (pid == 0)
+            {
+                jobTable = NULL; // the parent's jobs are not this process's children
+                jobCapacity = 0;
 
-    /* tokenization */
-    int tokenCount = 0;
-    char **tokens = tokenize(temp, &tokenCount);
-    if(tokenCount == 0)
-    {
-        free(tokens);
-        return 0;
-    }
+                if (chromeTrace.fd >= 0)
+                {
+                    char name[64];
+                    snprintf(name, sizeof(name), "chain at line %ld", numbers[start]);
+                    traceTrackName(getpid(), name);
+                }
 
-    /* extract args + redirection into a packet structure */
-    commandPacket packet = buildPacket(tokens, tokenCount);
-    free(tokens);
+                if (chain) // the chain's output goes to the shell
+                {
+                    dup2(writeEnds[0], STDOUT_FILENO);
+                    dup2(writeEnds[1], STDERR_FILENO);
+                    close(writeEnds[0]);
+                    close(writeEnds[1]);
+                }
 
-    /* commandArgument[0] is the executable name */
-    if(packet.commandArgument[0] == NULL)
-    {
-        freePacket(&packet);
-        return 0;
-    }
+                for (int j = start; j < i; j++)
+                {
+                    lineNumber = numbers[j];
+                    runCommand(lines[j]);
+                }
 
-    /* compute argument count */
-    char *command = packet.commandArgument[0];
+                fflush(stdout);
+                traceFlush();
+                _exit((lastStatus < 0) ? 0 : lastStatus & 0xff);
+            }
 
-    int argc = 0;
-    while(packet.commandArgument[argc] != NULL) argc++;
+            if (pid < 0) perror("fork");
 
-    /* flags to identify if command is a built-in && if redirection is used */
-    int isBuiltin = strcmp(command, "cd") == 0 || strcmp(command, "pwd") == 0 || strcmp(command, "which") == 0 || strcmp(command, "exit") == 0 || strcmp(command, "die")  == 0;
-    int hasRedirection = (packet.inputFile != NULL || packet.outputFile != NULL);
+            if (chain)
+            {
+                close(writeEnds[0]);
+                close(writeEnds[1]);
+            }
+        }
 
-    /* BUILT-INS WITHOUT REDIRECTION (run directly in parent) */
-    if(isBuiltin && !hasRedirection)
-    {
-        int status = 0;
+        int slot = watchChild(pid);
 
-        if (strcmp(command, "cd") == 0) 
+        if (chain && pid > 0)
         {
-            status = runCD(argc, packet.commandArgument);
-            freePacket(&packet);
-            return status;
+            chain->pid = pid;
+            chain->slot = slot;
+
+            if (queueOrderedChain(chain) == 0)
+            {
+                if (slot >= 0) running[runningCount++] = slot;
+                continue;
+            }
+
+            fprintf(stderr, "Error: Memory allocation failed.\n"); // its output is lost, the chain is only waited for below
         }
-        else if (strcmp(command, "pwd") == 0) 
+
+        if (chain) // fork failed or the chain could not be queued: its pipes are no longer read
         {
-            status = runPWD(argc);
-            freePacket(&packet);
-            return status;
+            for (int k = 0; k < 2; k++)
+            {
+                epoll_ctl(orderEpoll, EPOLL_CTL_DEL, chain->streams[k].fd, NULL);
+                close(chain->streams[k].fd);
+            }
+            free(chain);
         }
-        else if (strcmp(command, "which") == 0) 
+
+        if (slot >= 0)
         {
-            if (argc != 2) status = 1;
-            else status = runWhich(packet.commandArgument[1]);
-            freePacket(&packet);
-            return status;
+            running[runningCount++] = slot;
+            continue;
         }
-        else if (strcmp(command, "exit") == 0) 
+
+        if (pid > 0) // the chain cannot be watched, wait for it here
         {
-            freePacket(&packet);     
-            runExit();               
+            waitpid(pid, NULL, 0);
+            continue;
         }
-        else if (strcmp(command, "die") == 0) 
+
+        /* the chain runs in the shell once everything before it has finished, so cd, exit and die keep their order */
+        finishChains(running, &runningCount);
+        for (int j = start; j < i; j++)
         {
-            runDie(argc, packet.commandArgument);
+            lineNumber = numbers[j];
+            runCommand(lines[j]);
         }
-        
-        freePacket(&packet);
-        lastStatus = status;
-        return status;
     }
 
-    /* BUILT-INS WITH REDIRECTION */
-    if(isBuiltin && hasRedirection)
-    {
-        pid_t pid = fork();
-        
-        if(pid == 0)
-        {
-            if(packet.inputFile != NULL)
-            {
-                int fd = open(packet.inputFile, O_RDONLY);
-                if(fd < 0){
-                    fprintf(stderr, "no such file or directory: %s\n", packet.inputFile);
-                    exit(EXIT_FAILURE);
-                }
+    finishChains(running, &runningCount);
+    free(running);
 
-                dup2(fd, STDIN_FILENO);
-                close(fd);
-            } else if (!isatty(STDIN_FILENO)) {
-                applyDevNullIfBatchNoInput();
-            }
- 
-            if(packet.outputFile != NULL)
-            {
-                int fd = open(packet.outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0640);
-                if(fd < 0){ 
-                    exit(EXIT_FAILURE); 
-                }
+    if (orderEpoll >= 0)
+    {
+        close(orderEpoll);
+        orderEpoll = -1;
+    }
+}
 
-                dup2(fd, STDOUT_FILENO);
-                close(fd);
-            }
+/* function for -j mode: splits the whole input into lines and runs them as chains. The input is mapped when it is a regular file and read otherwise */
+int runParallelBatch()
+{
+    struct stat st;
+    char *text = NULL; // input, terminated after its last byte
+    size_t length = 0;
+    char *map = NULL;
+    size_t mapSize = 0;
+    char *lastCopy = NULL; // copy of a last line that cannot be terminated in place
 
-            if (strcmp(command, "pwd") == 0) exit(runPWD(argc));
+    off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
 
-            if (strcmp(command, "which") == 0) {
-                if (argc != 2) exit(EXIT_FAILURE);
-                exit(runWhich(packet.commandArgument[1]));
-            }
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset)
+    {
+        mapSize = st.st_size;
+        map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, STDIN_FILENO, 0);
+        if (map == MAP_FAILED) map = NULL;
+    }
 
-            if (strcmp(command, "exit") == 0) exit(EXIT_SUCCESS);
+    if (map)
+    {
+        posix_madvise(map, mapSize, POSIX_MADV_SEQUENTIAL);
+        lseek(STDIN_FILENO, mapSize, SEEK_SET);
+        text = map + offset;
+        length = mapSize - offset;
+    }
+    else
+    {
+        size_t capacity = BUFSIZE;
+        text = shellMalloc(capacity);
+        ssize_t bytes;
 
-            if (strcmp(command, "die") == 0) exit(EXIT_FAILURE);
+        while (text && (bytes = read(STDIN_FILENO, text + length, capacity - length - 1)) > 0)
+        {
+            length += bytes;
+            if (capacity - length > 1) continue;
 
-            exit(EXIT_FAILURE);
+            char *temp = shellRealloc(text, capacity * 2);
+            if (!temp) free(text);
+            text = temp;
+            capacity *= 2;
         }
 
-        int status;
-        waitpid(pid, &status, 0);
-
-        if (strcmp(command, "exit") == 0) {
-            freePacket(&packet);
-            runExit();
-        }
-        if (strcmp(command, "die") == 0) {
-            runDie(argc, packet.commandArgument);
+        if (!text)
+        {
+            fprintf(stderr, "Error: Memory allocation failed.\n");
+            return EXIT_FAILURE;
         }
-
-        freePacket(&packet);
-        lastStatus = status;
-        return WEXITSTATUS(status);
     }
 
-    /* EXTERNAL COMMAND (fork + exec) */
-    pid_t pid = fork();
-    if (pid == 0) // child process
+    /* split the lines in place, like the sequential reader; empty lines are dropped */
+    int count = 0, capacity = 64;
+    char **lines = shellMalloc(sizeof(char *) * capacity);
+    long *numbers = shellMalloc(sizeof(long) * capacity); // line number of each kept line
+    long number = 0;
+    char *p = text, *end = text + length;
+
+    while (lines && numbers && p < end)
     {
-        /* apply input redirection OR dev/null rule */
-        if (packet.inputFile != NULL) 
+        char *newline = memchr(p, '\n', end - p);
+
+        if (newline) *newline = '\0';
+        else if (!map || mapSize % sysconf(_SC_PAGESIZE) != 0) *end = '\0'; // room after the input
+        else
         {
-            int fd = open(packet.inputFile, O_RDONLY);
-            if (fd < 0){
-                fprintf(stderr, "no such file or directory: %s\n", packet.inputFile);
-                exit(1);
-            }
-            dup2(fd, STDIN_FILENO);
-            close(fd);
-        } else if (!isatty(STDIN_FILENO)) {
-            applyDevNullIfBatchNoInput();
+            lastCopy = shellMalloc(end - p + 1);
+            if (!lastCopy) break;
+            memcpy(lastCopy, p, end - p);
+            lastCopy[end - p] = '\0';
         }
 
-        /* apply output redirection */
-        if (packet.outputFile != NULL) 
+        if (count == capacity)
         {
-            int fd = open(packet.outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0640);
-            if (fd < 0) exit(EXIT_FAILURE);
+            char **temp = shellRealloc(lines, sizeof(char *) * capacity * 2);
+            if (!temp) break;
+            lines = temp;
 
-            dup2(fd, STDOUT_FILENO);
-            close(fd);
+            long *tempNumbers = shellRealloc(numbers, sizeof(long) * capacity * 2);
+            if (!tempNumbers) break;
+            numbers = tempNumbers;
+            capacity *= 2;
         }
 
-        char *directories[] = {"/usr/local/bin", "/usr/bin", "/bin", NULL};  // the only directories we will be searching for
-
-        /* check if program is passable as it stands */
-        if (access(command, X_OK) == 0) execv(command, packet.commandArgument);
-
-        /* another check if program is a bare name and passable by appending specified directories */
-        char path[BUFSIZE];
-        for (int i = 0; directories[i] != NULL; i++) {
-            snprintf(path, BUFSIZE, "%s/%s", directories[i], command);
-
-            if (access(path, X_OK) == 0) execv(path, packet.commandArgument);
+        char *line = (!newline && lastCopy) ? lastCopy : p;
+        number++;
+        if (*line != '\0')
+        {
+            numbers[count] = number;
+            lines[count++] = line;
         }
 
-        exit(EXIT_FAILURE);
-
+        p = newline ? newline + 1 : end;
     }
 
-    /* parent process waits for external command */
-    int status;
-    waitpid(pid, &status, 0);
-    int code = WEXITSTATUS(status);
-
-    /* If child executed die(), terminate entire shell */
-    if (dieFlag) {
-        runDie(1, NULL);
-    }
+    if (lines && numbers) runChains(lines, numbers, count);
+    else fprintf(stderr, "Error: Memory allocation failed.\n");
 
-    freePacket(&packet);
+    free(lines);
+    free(numbers);
+    free(lastCopy);
+    if (map) munmap(map, mapSize);
+    else free(text);
 
-    /* store exit status for future AND/OR conditions */
-    lastStatus = code;
-    return lastStatus;
+    fflush(stdout);
+    closeTraces();
+    return shellStatus;
 }
 
-int initializeShell(int argc, char *argv[])
+/* function to add bytes of the line being read to commandBuffer, growing it when needed */
+int appendToLine(const char *data, size_t length, size_t *lineLength, size_t *capacity)
 {
-    if (argc > 2)
+    if (*lineLength + length + 1 > *capacity)
     {
-        fprintf(stderr, "Error: There should be at most 2 arguments.\n");
-        return EXIT_FAILURE;
-    }
+        size_t newCapacity = *capacity;
+        while (*lineLength + length + 1 > newCapacity) newCapacity *= 2;
 
-    if (argc == 2)
-    {
-        char *batchFile = argv[1];
-        int status = runBatchFile(batchFile);
-        if (status != 0) return EXIT_FAILURE;
+        char *temp = shellRealloc(commandBuffer, newCapacity);
+        if (!temp)
+        {
+            fprintf(stderr, "Error: Memory reallocation failed.\n");
+            return -1;
+        }
+
+        commandBuffer = temp;
+        *capacity = newCapacity;
     }
 
-    interactive = isatty(STDIN_FILENO);
+    memcpy(commandBuffer + *lineLength, data, length);
+    *lineLength += length;
+    return 0;
+}
 
-    if (interactive)
-    {
-        printWelcome();
-        fflush(stdout);
-    }
+/* function to choose how STDOUT is buffered: built-in output collects in a large buffer when it does not go to a terminal,
+   but when STDERR is the same file (2>&1) each line is written as it ends, so output and error messages stay in order */
+void selectOutputBuffer()
+{
+    struct stat out, err;
+    if (isatty(STDOUT_FILENO)) return;
 
-    return EXIT_SUCCESS;
+    int shared = fstat(STDOUT_FILENO, &out) == 0 && fstat(STDERR_FILENO, &err) == 0 && out.st_dev == err.st_dev && out.st_ino == err.st_ino;
+    setvbuf(stdout, outputBuffer, shared ? _IOLBF : _IOFBF, sizeof(outputBuffer));
 }
 
 int runShell()
 {
-    commandBuffer = malloc(BUFSIZE);
+    selectOutputBuffer();
+
+    /* -j N runs a batch in chains; a terminal is always read line by line */
+    if (parallelSlots > 1 && !interactive) return runParallelBatch();
+
+    /* batch files (and STDIN redirected from a regular file) are mapped instead of read */
+    struct stat st;
+    if (!interactive && fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        if (runMappedBatch(STDIN_FILENO, (size_t)st.st_size) == 0)
+        {
+            fflush(stdout); // built-in output may still be buffered
+            closeTraces();
+            return shellStatus;
+        }
+    }
+
+    /* pipes and terminals are read in chunks */
+    commandBuffer = shellMalloc(BUFSIZE);
     if (!commandBuffer)
     {
         fprintf(stderr, "Error: Memory allocation failed.\n");
@@ -830,13 +4034,15 @@ int runShell()
     }
 
     char buffer[BUFSIZE];
-    int bytes;
+    ssize_t bytes;
 
-    int lineIndex = 0;
-    int capacity = BUFSIZE;
+    size_t lineLength = 0;
+    size_t capacity = BUFSIZE;
 
     while (1)
     {
+        pollJobs(); // collect background jobs that finished while the previous line ran, interactive mode reports them here
+
         if (interactive)
         {
             printf("mysh> ");
@@ -844,50 +4050,51 @@ int runShell()
         }
 
         bytes = read(STDIN_FILENO, buffer, BUFSIZE);
-        if (bytes == 0)
+        if (bytes <= 0)
         {
             if (interactive) printf("\n");
             break;
         }
 
-        for (int i = 0; i < bytes; i++)
+        /* find each newline with memchr and run the line it ends */
+        char *p = buffer;
+        char *end = buffer + bytes;
+
+        while (p < end)
         {
-            if (buffer[i] == '\n')
+            char *newline = memchr(p, '\n', end - p);
+            char *stop = newline ? newline : end;
+
+            if (appendToLine(p, stop - p, &lineLength, &capacity) < 0)
             {
-                if (lineIndex > 0)
-                {
-                    commandBuffer[lineIndex] = '\0';
-                    runCommand(commandBuffer);
-                    lineIndex = 0;
-                }
+                free(commandBuffer);
+                return EXIT_FAILURE;
             }
-            else
-            {
-                if (lineIndex >= capacity - 1)
-                {
-                    capacity *= 2;
-                    char *temp = realloc(commandBuffer, capacity);
-                    if (!temp)
-                    {
-                        fprintf(stderr, "Error: Memory reallocation failed.\n");
-                        free(commandBuffer);
-                        return EXIT_FAILURE;
-                    }
-                    commandBuffer = temp;
-                }
 
-                commandBuffer[lineIndex++] = buffer[i];
+            if (newline == NULL) break;
+
+            lineNumber++;
+            if (lineLength > 0)
+            {
+                commandBuffer[lineLength] = '\0';
+                runCommand(commandBuffer);
+                lineLength = 0;
             }
+
+            p = newline + 1;
         }
     }
 
-    if (lineIndex > 0)
+    if (lineLength > 0)
     {
-        commandBuffer[lineIndex] = '\0';
+        lineNumber++;
+        commandBuffer[lineLength] = '\0';
         runCommand(commandBuffer);
     }
 
     free(commandBuffer);
+    fflush(stdout); // built-in output may still be buffered
+    closeTraces();
     
     return shellStatus;
 }
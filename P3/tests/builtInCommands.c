@@ -865,6 +865,390 @@ int diePipelines()
     }
 }
 
+int hashSuccess()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Eighteen: Testing if program processes 'hash' command correctly.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/hashSuccess.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/hashSuccess.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    /* ls is looked up once and found in the table the second time; hash -r empties it */
+    const char *expected[] = {"hits\tcommand\n   2\t/", "/ls\n", "hits: 2\nmisses: 0\n", "directories: ", "commands: ", "hash: hash table empty\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 6))
+    {
+        printf("\nTest succeeded: Program correctly processed 'hash' command.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: Program incorrectly processed 'hash' command (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int builtInRedirection()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Nineteen: Testing if program runs built-in commands with redirection inside the shell.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/builtInRedirection.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/builtInRedirection.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    char which[BUFSIZE] = "", pwd[BUFSIZE] = "", cwd[BUFSIZE] = "", expected[2 * BUFSIZE];
+    readWholeFile("tests/files/redirectedWhich.out", which, sizeof(which));
+    readWholeFile("tests/files/redirectedPwd.out", pwd, sizeof(pwd));
+    unlink("tests/files/redirectedWhich.out");
+    unlink("tests/files/redirectedPwd.out");
+
+    /* the redirected output is in the files and nowhere else; STDOUT is back for echo, and cd tests is kept for pwd */
+    if (getcwd(cwd, sizeof(cwd)) == NULL) cwd[0] = '\0';
+    snprintf(expected, sizeof(expected), "Current working directory: %s\n", cwd);
+    size_t whichLength = strlen(which);
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && whichLength > 4 && strcmp(which + whichLength - 4, "/ls\n") == 0 &&
+        countLines(which, "") == 1 && strcmp(pwd, expected) == 0 && strncmp(output, "stdout restored\n", 16) == 0 &&
+        countLines(output, "") == 2 && strstr(output, "/tests\n") != NULL)
+    {
+        printf("\nTest succeeded: Program correctly processed built-in commands with redirection.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: Program incorrectly processed built-in commands with redirection (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int echoBuiltIn()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty: Testing if program processes the echo, printf, true and false built-ins correctly.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/echoBuiltIn.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/echoBuiltIn.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    /* a printf spec too long for the shell, or a * width out of range, is rejected instead of overflowing it;
+       a negative * precision is ignored and a negative * width left-justifies */
+    const char *expected[] = {"hello builtin\n", "no newline\n", "printf-42\n", "printf rejected the spec\n", "printf rejected the width\n",
+                              "[3.141590]\n", "[7   ]\n", "false failed\n", "true succeeded\n", "/echo\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 10))
+    {
+        printf("\nTest succeeded: Program correctly processed echo, printf, true and false.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: Program incorrectly processed echo, printf, true and false (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int memstatsSuccess()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty-One: Testing if program processes 'memstats' command correctly.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/memstatsSuccess.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/memstatsSuccess.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    /* the second line is parsed in the arena the first one left behind, so it makes no new heap allocations */
+    const char *expected[] = {"warm up\n", "heap allocations: ", "steady state\n", "heap allocations: "};
+    const char *first = strstr(output, "heap allocations: ");
+    const char *second = first ? strstr(first + 1, "heap allocations: ") : NULL;
+    long before = -1, after = -2;
+
+    if (first) sscanf(first, "heap allocations: %ld", &before);
+    if (second) sscanf(second, "heap allocations: %ld", &after);
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 4) && before == after &&
+        countLines(output, "arena blocks: ") == 2 && countLines(output, "arena bytes: ") == 2)
+    {
+        printf("\nTest succeeded: Program correctly processed 'memstats' command.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: Program incorrectly processed 'memstats' command (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int pipeSizeSuccess()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty-Two: Testing if program sets the pipe buffer size with set pipesize=N and a pipesize=N prefix.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/pipeSizeSuccess.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/pipeSizeSuccess.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    /* perl reads the size of the pipe it was given (F_GETPIPE_SZ); after set pipesize=0 it is the system default again */
+    const char *expected[] = {"pipesize=262144\n", "262144\n", "131072\n", "pipesize=default\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 4) &&
+        countLines(output, "262144") == 2 && countLines(output, "131072") == 1)
+    {
+        printf("\nTest succeeded: pipe buffer size set and reported.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: pipe buffer size was not set (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int catBuiltIn()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty-Three: Testing if program copies files with the cat built-in.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/catBuiltIn.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/catBuiltIn.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    char input[BUFSIZE] = "", copy[BUFSIZE] = "", expected[3 * BUFSIZE];
+    int inputLength = readWholeFile("tests/files/catBuiltIn.txt", input, sizeof(input));
+    int copyLength = readWholeFile("tests/files/catBuiltIn.out", copy, sizeof(copy));
+    unlink("tests/files/catBuiltIn.out");
+
+    /* file to file, then file to pipe (STDOUT is captured through one), then file to pipe to pipe */
+    snprintf(expected, sizeof(expected), "%s%scat failed\n", input, input);
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && inputLength > 0 && copyLength == inputLength &&
+        memcmp(copy, input, inputLength) == 0 && strncmp(output, expected, strlen(expected)) == 0 && strstr(output + strlen(expected), "/cat\n") != NULL)
+    {
+        printf("\nTest succeeded: cat copied the file unchanged to a file, to a pipe and through a pipe.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: cat built-in did not copy the file unchanged (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int jobsSuccess()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty-Four: Testing if program runs a background job with & and collects it with jobs and wait.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/jobsSuccess.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/jobsSuccess.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    /* a job killed by a signal is listed with the signal and fails wait, like one that exits nonzero; so does a command killed in the foreground */
+    const char *expected[] = {"started\n", "[1] Running\tsleep 0.2 | false\n", "job 1 failed\n", "[2] Killed\tperl -e kill(9,$$)\n", "job 3 was killed\n",
+                              "foreground job killed\n", "pipeline killed\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 7) && countLines(output, "wrong") == 0)
+    {
+        printf("\nTest succeeded: background job listed and waited for.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: background job was not handled (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int parallelBuiltIn()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty-Five: Testing if program runs a command template over a list of items with the parallel built-in.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/parallelBuiltIn.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/parallelBuiltIn.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCapturedFds(output, sizeof(output), 1, 1);
+
+    /* the items finish in any order, each exactly once; only the missing file fails, it is reported on STDERR and or runs */
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && countLines(output, "item one") == 1 &&
+        countLines(output, "item two") == 1 && countLines(output, "item three") == 1 &&
+        countLines(output, "tests/files/parallelBuiltIn.txt") == 1 && countLines(output, "parallel: item 2 (missing.txt) failed with status ") == 1 &&
+        countLines(output, "parallel: 1 of 2 items failed") == 1 && strstr(output, "one item failed\n") != NULL)
+    {
+        printf("\nTest succeeded: items were run and the failure was reported.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: parallel built-in did not run as expected (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int xargsBuiltIn()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty-Six: Testing if program packs input items into command lines with the xargs built-in.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/xargsBuiltIn.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/xargsBuiltIn.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    /* 53 words, 4 per line, make 14 lines; -r runs nothing without items, and an item too long for one argument
+       or for the whole command line stops xargs before it launches anything */
+    const char *expected[] = {"14\n", "item a\nitem b\nitem c\nxargs rejected the long item\nxargs rejected the longer item\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && strncmp(output, "14\n", 3) == 0 &&
+        linesInOrder(output, expected, 2) && countLines(output, "nothing to do") == 0)
+    {
+        printf("\nTest succeeded: items were packed into command lines.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: xargs built-in did not run as expected (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int timeReport()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty-Seven: Testing if program reports the time and resources of each command and pipeline stage with time and set time=on.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/timeReport.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/timeReport.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char errors[BUFSIZE];
+    int status = runShellCapturedFds(errors, sizeof(errors), 0, 1);
+
+    /* one report per stage and a total for the pipeline, for the time prefix and for set time=on, nothing once it is off */
+    const char *expected[] = {"time line=1 stage=1 pid=", "time line=2 stage=1 ", "time line=2 stage=2 ", "time line=2 stage=total pid=0 status=0 wall=",
+                              "cmd=echo one | cat\n", "time line=4 stage=1 ", "cmd=true\n", "time line=5 stage=1 ", "time line=7 stage=1 "};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(errors, expected, 9) &&
+        countLines(errors, "time line=") == 7 && countLines(errors, " status=0 wall=") == 6 && countLines(errors, " status=1 wall=") == 1 &&
+        countLines(errors, " user=") == 7 && countLines(errors, " maxrss_kb=") == 7 && countLines(errors, " majflt=") == 7)
+    {
+        printf("\nTest succeeded: time reported for each command and stage.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: time was not reported (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int outputOrder()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Twenty-Eight: Testing if program keeps built-in output and error messages in order when STDOUT and STDERR are the same file.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/outputOrder.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/outputOrder.txt");
+
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCapturedFds(output, sizeof(output), 1, 1);
+
+    const char *expected[] = {"one\n", "cd: ", "two\n", "Error: ", "three\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 5))
+    {
+        printf("\nTest succeeded: output and errors came out in line order.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: output and errors were out of order (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     int failures = 0;
@@ -891,9 +1275,31 @@ int main(int argc, char *argv[])
     failures += dieConditionals();
     failures += diePipelines();
 
+    failures += hashSuccess();
+
+    failures += builtInRedirection();
+
+    failures += echoBuiltIn();
+
+    failures += memstatsSuccess();
+
+    failures += pipeSizeSuccess();
+
+    failures += catBuiltIn();
+
+    failures += jobsSuccess();
+
+    failures += parallelBuiltIn();
+
+    failures += xargsBuiltIn();
+
+    failures += timeReport();
+
+    failures += outputOrder();
+
     printf("\n========================================\n");
     printf("Test Summary:\n");
-    printf("  Passed: %d/%d\n", 17 - failures, 17);
+    printf("  Passed: %d/%d\n", 28 - failures, 28);
     printf("========================================\n");
 
     // return number of failures (0 = all passed)
@@ -57,3 +57,115 @@ int printFile(const char *filename){
     return 0;
 }
 
+
+/* function to run the shell in a child with its STDOUT, its STDERR or both (on the same pipe, like 2>&1) captured in output
+   (NUL terminated, cut to size); the output is also printed. Returns the child's wait status, or -1 if it could not be run */
+int runShellCapturedFds(char *output, size_t size, int captureOut, int captureErr)
+{
+    int fds[2];
+    fflush(stdout);
+    if (pipe(fds) < 0) return -1;
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        if (captureOut) dup2(fds[1], STDOUT_FILENO);
+        if (captureErr) dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+
+        int childStatus = runShell();
+        fflush(stdout);
+        _exit(childStatus ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+
+    size_t used = 0;
+    char buffer[BUFSIZE];
+    int bytes;
+
+    while ((bytes = read(fds[0], buffer, sizeof(buffer))) > 0)
+    {
+        size_t keep = (used + bytes < size) ? (size_t)bytes : size - 1 - used;
+        memcpy(output + used, buffer, keep);
+        used += keep;
+    }
+
+    close(fds[0]);
+    output[used] = '\0';
+
+    printf("\n%s Result: \n%s", captureOut ? (captureErr ? "Stdout and Stderr" : "Stdout") : "Stderr", output);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+    {
+        perror("waitpid");
+        return -1;
+    }
+
+    return status;
+}
+
+/* function to run the shell in a child with its STDOUT captured in output (NUL terminated, cut to size); the output is also printed.
+   Returns the child's wait status, or -1 if it could not be run */
+int runShellCaptured(char *output, size_t size)
+{
+    return runShellCapturedFds(output, size, 1, 0);
+}
+
+/* function to check that each of the lines appears in output, in the given order */
+int linesInOrder(const char *output, const char **lines, int count)
+{
+    const char *from = output;
+
+    for (int i = 0; i < count; i++)
+    {
+        const char *found = strstr(from, lines[i]);
+        if (found == NULL) return 0;
+        from = found + strlen(lines[i]);
+    }
+
+    return 1;
+}
+
+/* function to count the lines of output that contain text */
+int countLines(const char *output, const char *text)
+{
+    int count = 0;
+
+    for (const char *line = output; *line; )
+    {
+        const char *end = strchr(line, '\n');
+        size_t length = end ? (size_t)(end - line) : strlen(line);
+
+        const char *found = strstr(line, text);
+        if (found && found < line + length) count++;
+
+        line += length + (end != NULL);
+    }
+
+    return count;
+}
+
+/* function to read a whole file into output (NUL terminated, cut to size); returns the bytes read, or -1 */
+int readWholeFile(const char *filename, char *output, size_t size)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+
+    size_t used = 0;
+    int bytes;
+
+    while (used < size - 1 && (bytes = read(fd, output + used, size - 1 - used)) > 0) used += bytes;
+
+    close(fd);
+    output[used] = '\0';
+    return used;
+}
@@ -167,6 +167,178 @@ int emptyBatch()
     }
 }
 
+int parallelChains()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Four: Testing if program runs independent chains of a batch file in parallel with -j 4.\n\n");
+
+    char *argv[] = {"mysh", "-j", "4", "tests/files/parallelChains.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/parallelChains.txt");
+
+    int initStatus = initializeShell(4, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    /* run one after the other, the chains would print in script order; cd waits for every chain before it */
+    const char *expected[] = {"third chain recovered\n", "second chain\n", "first chain\n", "/tests\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 4))
+    {
+        printf("\nTest succeeded: chains ran in parallel and kept their and/or status.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: chains were not run correctly (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int keepOrderOutput()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Five: Testing if program keeps the output of parallel chains in script order with -j 4 -k.\n\n");
+
+    char *argv[] = {"mysh", "-j", "4", "-k", "tests/files/keepOrderOutput.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/keepOrderOutput.txt");
+
+    int initStatus = initializeShell(5, argv);
+    (void)initStatus; 
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    /* the chains finish in reverse order, -k must still print them in script order */
+    const char *expected[] = {"first\n", "second\n", "third\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 3))
+    {
+        printf("\nTest succeeded: output came out in script order.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: output was not kept in order (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int traceRecords()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Six: Testing if program writes one JSON trace record per command and pipeline stage with MYSH_TRACE.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/traceRecords.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/traceRecords.txt");
+
+    char traceFile[] = "/tmp/myshTraceXXXXXX";
+    int traceFd = mkstemp(traceFile);
+    if (traceFd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    close(traceFd);
+
+    setenv("MYSH_TRACE", traceFile, 1);
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+    unsetenv("MYSH_TRACE");
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+
+    char trace[BUFSIZE];
+    int traced = readWholeFile(traceFile, trace, sizeof(trace));
+    unlink(traceFile);
+    printf("\nTrace Result: \n%s", (traced < 0) ? "" : trace);
+
+    /* one record per stage: echo, then echo and cat of the pipeline, then ls with the path it was found at */
+    const char *records[] = {"{\"line\":1,\"stage\":1,\"argv\":[\"echo\",\"traced\",\"line\"],\"path\":null,\"builtin\":true,",
+                             "{\"line\":2,\"stage\":1,\"argv\":[\"echo\",\"two\",\"stages\"],",
+                             "{\"line\":2,\"stage\":2,\"argv\":[\"cat\"],",
+                             "{\"line\":3,\"stage\":1,\"argv\":[\"ls\",\"tests/files/traceRecords.txt\"],\"path\":\"/"};
+    const char *expected[] = {"traced line\n", "two stages\n", "tests/files/traceRecords.txt\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 3) && traced > 0 &&
+        countLines(trace, "{\"line\":") == 4 && countLines(trace, "\"exit\":0}") == 4 &&
+        countLines(trace, "/ls\",\"builtin\":false,") == 1 && linesInOrder(trace, records, 4))
+    {
+        printf("\nTest succeeded: one trace record written for each stage.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: trace records were not written (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
+int chromeTraceEvents()
+{
+    printf("_________________________________________________\n\n");
+    printf("Test Seven: Testing if program writes Chrome trace events for parsing, built-ins, spawns, child runs and waits with MYSH_CHROME_TRACE.\n\n");
+
+    char *argv[] = {"mysh", "tests/files/chromeTraceEvents.txt"};
+
+    printf("Batch File Input: \n");
+    printFile("tests/files/chromeTraceEvents.txt");
+
+    char traceFile[] = "/tmp/myshChromeXXXXXX";
+    int traceFd = mkstemp(traceFile);
+    if (traceFd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    close(traceFd);
+
+    setenv("MYSH_CHROME_TRACE", traceFile, 1);
+    int initStatus = initializeShell(2, argv);
+    (void)initStatus; 
+    unsetenv("MYSH_CHROME_TRACE");
+
+    char output[BUFSIZE];
+    int status = runShellCaptured(output, sizeof(output));
+    closeTraces(); // this process opened the trace, so it closes the array as the shell would when it finishes
+
+    char trace[BUFSIZE];
+    int traced = readWholeFile(traceFile, trace, sizeof(trace));
+    unlink(traceFile);
+    printf("\nTrace Result: \n%s", (traced < 0) ? "" : trace);
+
+    /* line 1 is parsed and runs echo in the shell; line 2 is parsed and starts ls and cat, each on a track named after it */
+    const char *events[] = {"[\n{\"name\":\"process_name\",", "{\"name\":\"parse\",", "{\"name\":\"echo\",\"ph\":\"X\",",
+                            "{\"name\":\"parse\",", "{\"name\":\"trace_end\",", "]\n"};
+    const char *expected[] = {"timeline\n", "tests/files/chromeTraceEvents.txt\n"};
+
+    if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && linesInOrder(output, expected, 2) && traced > 0 &&
+        linesInOrder(trace, events, 6) && countLines(trace, "{\"name\":\"parse\",") == 2 && countLines(trace, "{\"name\":\"spawn\",") == 2 &&
+        countLines(trace, "{\"name\":\"wait\",") == 1 && countLines(trace, "{\"name\":\"thread_name\",") == 3 &&
+        countLines(trace, "{\"name\":\"ls\",\"ph\":\"X\",") == 1 && countLines(trace, "{\"name\":\"cat\",\"ph\":\"X\",") == 1)
+    {
+        printf("\nTest succeeded: Chrome trace events written.\n");
+        return 0;
+    }
+    else
+    {
+        printf("\nTest failed: Chrome trace events were not written (child exit code %d).\n",
+               (status >= 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     int failures = 0;
@@ -175,9 +347,17 @@ int main(int argc, char *argv[])
     failures += unableToOpenBatchFile();
     failures += emptyBatch();
 
+    failures += parallelChains();
+
+    failures += keepOrderOutput();
+
+    failures += traceRecords();
+
+    failures += chromeTraceEvents();
+
     printf("\n========================================\n");
     printf("Test Summary:\n");
-    printf("  Passed: %d/%d\n", 3 - failures, 3);
+    printf("  Passed: %d/%d\n", 7 - failures, 7);
     printf("========================================\n");
 
     // return number of failures (0 = all passed)